@@ -526,6 +526,9 @@ extern void flush_tlb_range(struct vm_area_struct *vma, unsigned long start, uns
 extern void flush_tlb_kernel_range(unsigned long start, unsigned long end);
 #endif
 
+/* flush_tlb_kernel_range() goes page by page, see mm/vmalloc.c */
+#define ARCH_HAS_RANGED_KERNEL_TLB_FLUSH
+
 /*
  * If PG_dcache_clean is not set for the page, we need to ensure that any
  * cache entries for the kernels virtual memory range are written
@@ -257,7 +257,7 @@ static int __init e1000_init_module(void)
 	return ret;
 }
 
-module_init(e1000_init_module);
+device_initcall_parallel(e1000_init_module);
 
 /**
  * e1000_exit_module - Driver Exit Cleanup Routine
@@ -5198,7 +5198,7 @@ static void __exit sky2_cleanup_module(void)
 	sky2_debug_cleanup();
 }
 
-module_init(sky2_init_module);
+device_initcall_parallel(sky2_init_module);
 module_exit(sky2_cleanup_module);
 
 MODULE_DESCRIPTION("Marvell Yukon 2 Gigabit Ethernet driver");
@@ -6304,5 +6304,5 @@ MODULE_LICENSE("GPL");
 
 MODULE_DEVICE_TABLE(pci, pci_tbl);
 
-module_init(init_nic);
+device_initcall_parallel(init_nic);
 module_exit(exit_nic);
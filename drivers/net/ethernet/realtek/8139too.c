@@ -2618,5 +2618,5 @@ static void __exit rtl8139_cleanup_module (void)
 }
 
 
-module_init(rtl8139_init_module);
+device_initcall_parallel(rtl8139_init_module);
 module_exit(rtl8139_cleanup_module);
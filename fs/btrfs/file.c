@@ -1565,6 +1565,10 @@ out:
 
 static const struct vm_operations_struct btrfs_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= filemap_pmd_fault,
+#endif
 	.page_mkwrite	= btrfs_page_mkwrite,
 };
 
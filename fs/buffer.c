@@ -609,10 +609,16 @@ EXPORT_SYMBOL(mark_buffer_dirty_inode);
  *
  * If warn is true, then emit a warning if the page is not uptodate and has
  * not been truncated.
+ *
+ * If page_locked is true, the caller holds the page lock, and the radix tree
+ * can usually be tagged without taking the tree_lock.
  */
 static void __set_page_dirty(struct page *page,
-		struct address_space *mapping, int warn)
+		struct address_space *mapping, int warn, int page_locked)
 {
+	if (page_locked && account_and_tag_page_dirty_locked(page, mapping))
+		goto out;
+
 	spin_lock_irq(&mapping->tree_lock);
 	if (page->mapping) {	/* Race with truncate? */
 		WARN_ON_ONCE(warn && !PageUptodate(page));
@@ -621,6 +627,7 @@ static void __set_page_dirty(struct page *page,
 				page_index(page), PAGECACHE_TAG_DIRTY);
 	}
 	spin_unlock_irq(&mapping->tree_lock);
+out:
 	__mark_inode_dirty(mapping->host, I_DIRTY_PAGES);
 }
 
@@ -671,7 +678,7 @@ int __set_page_dirty_buffers(struct page *page)
 	spin_unlock(&mapping->private_lock);
 
 	if (newly_dirty)
-		__set_page_dirty(page, mapping, 1);
+		__set_page_dirty(page, mapping, 1, 0);
 	return newly_dirty;
 }
 EXPORT_SYMBOL(__set_page_dirty_buffers);
@@ -1100,7 +1107,7 @@ __getblk_slow(struct block_device *bdev, sector_t block, int size)
  * mark_buffer_dirty() is atomic.  It takes bh->b_page->mapping->private_lock,
  * mapping->tree_lock and mapping->host->i_lock.
  */
-void mark_buffer_dirty(struct buffer_head *bh)
+static void __mark_buffer_dirty(struct buffer_head *bh, int page_locked)
 {
 	WARN_ON_ONCE(!buffer_uptodate(bh));
 
@@ -1121,10 +1128,16 @@ void mark_buffer_dirty(struct buffer_head *bh)
 		if (!TestSetPageDirty(page)) {
 			struct address_space *mapping = page_mapping(page);
 			if (mapping)
-				__set_page_dirty(page, mapping, 0);
+				__set_page_dirty(page, mapping, 0,
+						 page_locked);
 		}
 	}
 }
+
+void mark_buffer_dirty(struct buffer_head *bh)
+{
+	__mark_buffer_dirty(bh, 0);
+}
 EXPORT_SYMBOL(mark_buffer_dirty);
 
 /*
@@ -1882,7 +1895,8 @@ static int __block_commit_write(struct inode *inode, struct page *page,
 				partial = 1;
 		} else {
 			set_buffer_uptodate(bh);
-			mark_buffer_dirty(bh);
+			/* Our callers hold the page lock */
+			__mark_buffer_dirty(bh, 1);
 		}
 		clear_buffer_new(bh);
 	}
@@ -143,6 +143,10 @@ ext4_file_write(struct kiocb *iocb, const struct iovec *iov,
 
 static const struct vm_operations_struct ext4_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= filemap_pmd_fault,
+#endif
 	.page_mkwrite   = ext4_page_mkwrite,
 };
 
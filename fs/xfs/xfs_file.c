@@ -1092,5 +1092,9 @@ const struct file_operations xfs_dir_file_operations = {
 
 static const struct vm_operations_struct xfs_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= filemap_pmd_fault,
+#endif
 	.page_mkwrite	= xfs_vm_page_mkwrite,
 };
@@ -42,6 +42,9 @@ enum bdi_stat_item {
 	BDI_WRITEBACK,
 	BDI_DIRTIED,
 	BDI_WRITTEN,
+	BDI_RA_PAGES,
+	BDI_RA_HITS,
+	BDI_RA_WASTE,
 	NR_BDI_STAT_ITEMS
 };
 
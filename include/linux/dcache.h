@@ -188,6 +188,9 @@ struct dentry_operations {
 #define DCACHE_NEED_AUTOMOUNT	0x20000	/* handle automount on this dir */
 #define DCACHE_MANAGE_TRANSIT	0x40000	/* manage transit from this dirent */
 #define DCACHE_NEED_LOOKUP	0x80000 /* dentry requires i_op->lookup */
+#define DCACHE_LRU_LIST		0x100000 /* on the sb LRU or a shrink list */
+#define DCACHE_DENTRY_KILLED	0x200000 /* killed while on a shrink list */
+#define DCACHE_MAY_FREE		0x400000 /* ... and left for its owner to free */
 #define DCACHE_MANAGED_DENTRY \
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
@@ -396,6 +396,7 @@ struct inodes_stat_t {
 #include <linux/rculist_bl.h>
 #include <linux/atomic.h>
 #include <linux/shrinker.h>
+#include <linux/list_lru.h>
 #include <linux/migrate_mode.h>
 
 #include <asm/byteorder.h>
@@ -948,6 +949,18 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * A sequential readahead stream, parked while another stream of the same
+ * file is being read, see mm/readahead.c
+ */
+struct ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
+#define RA_PARKED_STREAMS	3
+
 /*
  * Track a single file's readahead state
  */
@@ -960,6 +973,17 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	/* Other interleaved streams, most recently used first */
+	struct ra_stream parked[RA_PARKED_STREAMS];
+
+	pgoff_t stride_prev;		/* Start of last strided read */
+	long stride;			/* Distance between strided reads */
+	unsigned int stride_count;	/* # of reads seen at that distance */
+
+	unsigned int hits;		/* Readahead pages used ... */
+	unsigned int waste;		/* ... and unused, this period */
+	unsigned int shrink;		/* log2 of ra_pages / window limit */
 };
 
 /*
@@ -1448,14 +1472,13 @@ struct super_block {
 	struct list_head	s_files;
 #endif
 	struct list_head	s_mounts;	/* list of mounts; _not_ for fs use */
-	/* s_dentry_lru, s_nr_dentry_unused protected by dcache.c lru locks */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
 
-	/* s_inode_lru_lock protects s_inode_lru and s_nr_inodes_unused */
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		/* unused inode lru */
-	int			s_nr_inodes_unused;	/* # of inodes on lru */
+	/*
+	 * Unused dentries and inodes, on per-node lists with their own
+	 * locks so that reclaim on one node stays on that node.
+	 */
+	struct list_lru		s_dentry_lru ____cacheline_aligned_in_smp;
+	struct list_lru		s_inode_lru ____cacheline_aligned_in_smp;
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1515,8 +1538,10 @@ struct super_block {
 };
 
 /* superblock cache pruning functions */
-extern void prune_icache_sb(struct super_block *sb, int nr_to_scan);
-extern void prune_dcache_sb(struct super_block *sb, int nr_to_scan);
+extern void prune_icache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    int nid);
+extern void prune_dcache_sb(struct super_block *sb, unsigned long nr_to_scan,
+			    int nid);
 
 extern struct timespec current_fs_time(struct super_block *sb);
 
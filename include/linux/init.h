@@ -145,6 +145,22 @@ extern initcall_t __security_initcall_start[], __security_initcall_end[];
 /* Used for contructor calls. */
 typedef void (*ctor_fn_t)(void);
 
+/*
+ * An initcall which may run concurrently with the other parallel
+ * initcalls of its level, once those named in @deps have returned.
+ * See the *_initcall_parallel() macros below.
+ */
+struct parallel_initcall {
+	initcall_t fn;
+	const char *name;
+	const char * const *deps;
+	unsigned int nr_deps;
+	unsigned int level;
+	/* private to do_initcalls() */
+	struct parallel_initcall *next;
+	unsigned int waiting;
+};
+
 /* Defined in init/main.c */
 extern int do_one_initcall(initcall_t fn);
 extern char __initdata boot_command_line[];
@@ -212,6 +228,52 @@ extern bool initcall_debug;
 
 #define __initcall(fn) device_initcall(fn)
 
+/*
+ * Parallel initcalls run after the other initcalls of their level, and
+ * before its _sync ones. With "initcall_parallel" on the command line,
+ * they run concurrently on all CPUs; otherwise they run one after the
+ * other in link order. Either way, one only starts once the parallel
+ * initcalls of the same level named in its optional dependency list
+ * have returned, e.g.
+ *
+ *	device_initcall_parallel(foo_init, "bar_init", "baz_init");
+ *
+ * Only mark initcalls which do not rely on running in the init task,
+ * nor on any other initcall of their level but those they name.
+ */
+#define __define_parallel_initcall(lvl, initfn, ...)			\
+	static const char * const __initcall_deps_##initfn[]		\
+	__initconst = { __VA_ARGS__ };					\
+	static struct parallel_initcall __parallel_initcall_##initfn	\
+	__initdata = {							\
+		.fn	 = initfn,					\
+		.name	 = #initfn,					\
+		.deps	 = __initcall_deps_##initfn,			\
+		.nr_deps = sizeof(__initcall_deps_##initfn) /		\
+			   sizeof(__initcall_deps_##initfn[0]),		\
+		.level	 = lvl,						\
+	};								\
+	static struct parallel_initcall *__parallel_initcall_ptr_##initfn \
+	__used __section(.initcall_parallel.init) =			\
+		&__parallel_initcall_##initfn
+
+#define pure_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall(0, fn, ##__VA_ARGS__)
+#define core_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall(1, fn, ##__VA_ARGS__)
+#define postcore_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall(2, fn, ##__VA_ARGS__)
+#define arch_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall(3, fn, ##__VA_ARGS__)
+#define subsys_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall(4, fn, ##__VA_ARGS__)
+#define fs_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall(5, fn, ##__VA_ARGS__)
+#define device_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall(6, fn, ##__VA_ARGS__)
+#define late_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall(7, fn, ##__VA_ARGS__)
+
 #define __exitcall(fn) \
 	static exitcall_t __exitcall_##fn __exit_call = fn
 
@@ -290,6 +352,14 @@ void __init parse_early_options(char *cmdline);
 #define device_initcall(fn)		module_init(fn)
 #define late_initcall(fn)		module_init(fn)
 
+#define core_initcall_parallel(fn, ...)		module_init(fn)
+#define postcore_initcall_parallel(fn, ...)	module_init(fn)
+#define arch_initcall_parallel(fn, ...)		module_init(fn)
+#define subsys_initcall_parallel(fn, ...)	module_init(fn)
+#define fs_initcall_parallel(fn, ...)		module_init(fn)
+#define device_initcall_parallel(fn, ...)	module_init(fn)
+#define late_initcall_parallel(fn, ...)		module_init(fn)
+
 #define security_initcall(fn)		module_init(fn)
 
 /* Each module must use one module_init(). */
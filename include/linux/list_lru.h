@@ -0,0 +1,110 @@
+/*
+ * Per-node LRU lists for shrinkable objects
+ *
+ * Objects are kept on the list of the node their memory lives on, with a
+ * lock and a count per node, so that reclaim on one node only walks and
+ * locks that node's list.
+ */
+#ifndef _LINUX_LIST_LRU_H
+#define _LINUX_LIST_LRU_H
+
+#include <linux/list.h>
+#include <linux/nodemask.h>
+#include <linux/spinlock.h>
+
+/* list_lru_walk_cb has to always return one of those */
+enum lru_status {
+	LRU_REMOVED,		/* item removed from list */
+	LRU_ROTATE,		/* item referenced, give another pass */
+	LRU_SKIP,		/* item cannot be locked, skip */
+	LRU_RETRY,		/* item not freeable, lru lock was dropped */
+};
+
+struct list_lru_node {
+	spinlock_t		lock;
+	struct list_head	list;
+	/* kept as signed so we can catch imbalance bugs */
+	long			nr_items;
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_node	*node;
+	nodemask_t		active_nodes;
+};
+
+extern int list_lru_init(struct list_lru *lru);
+extern void list_lru_destroy(struct list_lru *lru);
+
+/*
+ * list_lru_add: add an element to the lru list's tail
+ * @lru: the lru pointer
+ * @item: the item to be added
+ *
+ * The node is that of the memory @item lives in.  The caller must hold
+ * whatever lock keeps @item from being added or removed concurrently,
+ * or know that @item is not on any list.
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+extern bool list_lru_add(struct list_lru *lru, struct list_head *item);
+
+/*
+ * list_lru_del: delete an element from the lru list
+ * @lru: the lru pointer
+ * @item: the item to be deleted
+ *
+ * Return value: true if the list was updated, false otherwise
+ */
+extern bool list_lru_del(struct list_lru *lru, struct list_head *item);
+
+extern unsigned long list_lru_count_node(struct list_lru *lru, int nid);
+
+static inline unsigned long list_lru_count(struct list_lru *lru)
+{
+	unsigned long count = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes)
+		count += list_lru_count_node(lru, nid);
+
+	return count;
+}
+
+/*
+ * The walk callback is called with the node's list lock held.  It may
+ * only drop that lock if it returns LRU_RETRY, and must retake it first.
+ */
+typedef enum lru_status
+(*list_lru_walk_cb)(struct list_head *item, spinlock_t *lock, void *cb_arg);
+
+/*
+ * list_lru_walk_node: walk a node's list, oldest items first
+ * @lru: the lru pointer
+ * @nid: the node id to scan from
+ * @isolate: callback applied to each item visited
+ * @cb_arg: opaque argument passed to @isolate
+ * @nr_to_walk: how many items to visit; decremented as they are
+ *
+ * Returns the number of items for which @isolate returned LRU_REMOVED.
+ */
+extern unsigned long list_lru_walk_node(struct list_lru *lru, int nid,
+					list_lru_walk_cb isolate, void *cb_arg,
+					unsigned long *nr_to_walk);
+
+static inline unsigned long list_lru_walk(struct list_lru *lru,
+					  list_lru_walk_cb isolate,
+					  void *cb_arg,
+					  unsigned long nr_to_walk)
+{
+	unsigned long isolated = 0;
+	int nid;
+
+	for_each_node_mask(nid, lru->active_nodes) {
+		isolated += list_lru_walk_node(lru, nid, isolate, cb_arg,
+					       &nr_to_walk);
+		if (!nr_to_walk)
+			break;
+	}
+	return isolated;
+}
+#endif /* _LINUX_LIST_LRU_H */
@@ -9,6 +9,8 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
+#include <linux/range_lock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -252,6 +254,13 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t vm_sequence;		/* Bumped around changes that
+					 * speculative faults must see */
+	atomic_t vm_ref_count;		/* Held by mm_rb and by speculative
+					 * faults, see get_vma() */
+	struct rcu_head vm_rcu_head;	/* Freed after lockless lookups */
+#endif
 };
 
 struct core_thread {
@@ -269,6 +278,7 @@ enum {
 	MM_FILEPAGES,
 	MM_ANONPAGES,
 	MM_SWAPENTS,
+	MM_FAULTAROUND,		/* pages mapped by fault-around, not rss */
 	NR_MM_COUNTERS
 };
 
@@ -288,6 +298,10 @@ struct mm_rss_stat {
 struct mm_struct {
 	struct vm_area_struct * mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t mm_rb_seq;			/* Bumped around mm_rb changes,
+						 * for lookups without mmap_sem */
+#endif
 	struct vm_area_struct * mmap_cache;	/* last find_vma result */
 #ifdef CONFIG_MMU
 	unsigned long (*get_unmapped_area) (struct file *filp,
@@ -306,6 +320,9 @@ struct mm_struct {
 
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
 	struct rw_semaphore mmap_sem;
+	struct range_lock_tree mmap_range;	/* Address ranges whose page
+						 * tables are being torn down
+						 * without mmap_sem */
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
 						 * together off init_mm.mmlist, and are protected
@@ -388,6 +405,14 @@ struct mm_struct {
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies after which the next NUMA hinting scan may start */
+	unsigned long numa_next_scan;
+
+	/* where the next scan resumes, and how many full passes were made */
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -267,6 +267,9 @@ struct module
 	const unsigned long *gpl_future_crcs;
 	unsigned int num_gpl_future_syms;
 
+	/* All of the above, hashed by name (see kernel/module.c). */
+	struct module_symindex *symindex;
+
 	/* Exception table */
 	unsigned int num_exentries;
 	struct exception_table_entry *extable;
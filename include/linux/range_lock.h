@@ -0,0 +1,55 @@
+#ifndef _LINUX_RANGE_LOCK_H
+#define _LINUX_RANGE_LOCK_H
+
+/*
+ * Range locks: sleeping exclusive locks over [start, end) ranges of some
+ * index space, where holders of disjoint ranges do not wait for each
+ * other.  Held ranges are kept on a plain list: this is meant for a
+ * handful of concurrent holders, not for heavily contended use.
+ */
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+struct range_lock_tree {
+	spinlock_t		lock;
+	struct list_head	head;	/* held range_locks */
+	wait_queue_head_t	wait;
+};
+
+struct range_lock {
+	struct list_head	node;
+	unsigned long		start;
+	unsigned long		end;	/* exclusive */
+};
+
+#define __RANGE_LOCK_TREE_INITIALIZER(name)				\
+	{ .lock = __SPIN_LOCK_UNLOCKED(name.lock),			\
+	  .head = LIST_HEAD_INIT(name.head),				\
+	  .wait = __WAIT_QUEUE_HEAD_INITIALIZER(name.wait) }
+
+static inline void range_lock_tree_init(struct range_lock_tree *tree)
+{
+	spin_lock_init(&tree->lock);
+	INIT_LIST_HEAD(&tree->head);
+	init_waitqueue_head(&tree->wait);
+}
+
+static inline void range_lock_init(struct range_lock *lock,
+				   unsigned long start, unsigned long end)
+{
+	INIT_LIST_HEAD(&lock->node);
+	lock->start = start;
+	lock->end = end;
+}
+
+extern int range_trylock(struct range_lock_tree *tree, struct range_lock *lock);
+extern void range_lock(struct range_lock_tree *tree, struct range_lock *lock);
+extern void range_unlock(struct range_lock_tree *tree, struct range_lock *lock);
+extern int range_is_locked(struct range_lock_tree *tree,
+			   unsigned long start, unsigned long end);
+extern void range_wait_unlocked(struct range_lock_tree *tree,
+				unsigned long start, unsigned long end);
+
+#endif /* _LINUX_RANGE_LOCK_H */
@@ -31,6 +31,7 @@ struct shmem_sb_info {
 	uid_t uid;		    /* Mount uid for root directory */
 	gid_t gid;		    /* Mount gid for root directory */
 	umode_t mode;		    /* Mount mode for root directory */
+	bool huge;		    /* Allocate huge pages for mappings */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
 };
 
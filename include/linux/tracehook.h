@@ -183,6 +183,8 @@ static inline void set_notify_resume(struct task_struct *task)
  */
 static inline void tracehook_notify_resume(struct pt_regs *regs)
 {
+	/* NUMA balancing scans the address space here */
+	task_numa_work();
 }
 #endif	/* TIF_NOTIFY_RESUME */
 
@@ -648,8 +648,6 @@ static void __init do_ctors(void)
 bool initcall_debug;
 core_param(initcall_debug, initcall_debug, bool, 0644);
 
-static char msgbuf[64];
-
 static int __init_or_module do_one_initcall_debug(initcall_t fn)
 {
 	ktime_t calltime, delta, rettime;
@@ -671,6 +669,7 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	char msgbuf[64];
 	int ret;
 
 	if (initcall_debug)
@@ -700,15 +699,238 @@ int __init_or_module do_one_initcall(initcall_t fn)
 
 
 extern initcall_t __initcall_start[], __initcall_end[], __early_initcall_end[];
+extern initcall_t __initcall0_start[], __initcall1_start[], __initcall2_start[],
+		  __initcall3_start[], __initcall4_start[], __initcall5_start[],
+		  __initcall6_start[], __initcall7_start[];
+extern initcall_t __initcall0s_start[], __initcall1s_start[],
+		  __initcall2s_start[], __initcall3s_start[],
+		  __initcall4s_start[], __initcall5s_start[],
+		  __initcall6s_start[], __initcall7s_start[];
+extern struct parallel_initcall *__parallel_initcall_start[],
+				*__parallel_initcall_end[];
+
+static initcall_t *initcall_levels[] __initdata = {
+	__initcall0_start,
+	__initcall1_start,
+	__initcall2_start,
+	__initcall3_start,
+	__initcall4_start,
+	__initcall5_start,
+	__initcall6_start,
+	__initcall7_start,
+	__initcall_end,
+};
+
+static initcall_t *initcall_sync_levels[] __initdata = {
+	__initcall0s_start,
+	__initcall1s_start,
+	__initcall2s_start,
+	__initcall3s_start,
+	__initcall4s_start,
+	__initcall5s_start,
+	__initcall6s_start,
+	__initcall7s_start,
+};
+
+static bool initcall_parallel;
+core_param(initcall_parallel, initcall_parallel, bool, 0444);
 
-static void __init do_initcalls(void)
+/*
+ * Parallel initcalls of the current level: those whose dependencies
+ * have all returned are queued on a FIFO, from which the boot thread
+ * and, with initcall_parallel, one worker thread per other CPU take
+ * them.
+ */
+static __initdata DEFINE_SPINLOCK(parallel_initcall_lock);
+static __initdata DECLARE_WAIT_QUEUE_HEAD(parallel_initcall_wait);
+static struct parallel_initcall *parallel_initcall_head __initdata;
+static struct parallel_initcall **parallel_initcall_tail __initdata;
+static unsigned int parallel_initcall_left __initdata;
+static unsigned int parallel_initcall_running __initdata;
+
+#define for_each_parallel_initcall(p)					\
+	for (p = __parallel_initcall_start; p < __parallel_initcall_end; p++)
+
+static bool __init parallel_initcall_depends(struct parallel_initcall *call,
+					     struct parallel_initcall *dep)
+{
+	unsigned int i;
+
+	if (call == dep)
+		return false;
+	for (i = 0; i < call->nr_deps; i++)
+		if (!strcmp(call->deps[i], dep->name))
+			return true;
+	return false;
+}
+
+static void __init parallel_initcall_queue(struct parallel_initcall *call)
+{
+	call->next = NULL;
+	*parallel_initcall_tail = call;
+	parallel_initcall_tail = &call->next;
+}
+
+/* Called with parallel_initcall_lock held */
+static void __init parallel_initcall_done(struct parallel_initcall *done)
+{
+	struct parallel_initcall **p;
+
+	for_each_parallel_initcall(p) {
+		struct parallel_initcall *call = *p;
+
+		if (call->level == done->level && call->waiting &&
+		    parallel_initcall_depends(call, done) && !--call->waiting)
+			parallel_initcall_queue(call);
+	}
+	parallel_initcall_running--;
+	parallel_initcall_left--;
+	wake_up_all(&parallel_initcall_wait);
+}
+
+/*
+ * Nothing queued and nothing running, but initcalls left: they depend
+ * on each other. Start the first of them anyway.
+ */
+static void __init parallel_initcall_break_cycle(unsigned int level)
+{
+	struct parallel_initcall **p;
+
+	for_each_parallel_initcall(p) {
+		struct parallel_initcall *call = *p;
+
+		if (call->level == level && call->waiting) {
+			pr_warn("initcall %s: circular dependency, "
+				"starting it anyway\n", call->name);
+			call->waiting = 0;
+			parallel_initcall_queue(call);
+			return;
+		}
+	}
+}
+
+static void __init parallel_initcall_worker(unsigned int level)
+{
+	struct parallel_initcall *call;
+
+	spin_lock(&parallel_initcall_lock);
+	while (parallel_initcall_left) {
+		call = parallel_initcall_head;
+		if (!call) {
+			if (!parallel_initcall_running) {
+				parallel_initcall_break_cycle(level);
+				continue;
+			}
+			spin_unlock(&parallel_initcall_lock);
+			wait_event(parallel_initcall_wait,
+				   ACCESS_ONCE(parallel_initcall_head) ||
+				   !ACCESS_ONCE(parallel_initcall_left));
+			spin_lock(&parallel_initcall_lock);
+			continue;
+		}
+		parallel_initcall_head = call->next;
+		if (!parallel_initcall_head)
+			parallel_initcall_tail = &parallel_initcall_head;
+		parallel_initcall_running++;
+		spin_unlock(&parallel_initcall_lock);
+
+		do_one_initcall(call->fn);
+
+		spin_lock(&parallel_initcall_lock);
+		parallel_initcall_done(call);
+	}
+	spin_unlock(&parallel_initcall_lock);
+}
+
+static int __init parallel_initcall_thread(void *data)
+{
+	parallel_initcall_worker((unsigned long)data);
+
+	/* wait for do_parallel_initcalls() to reap us */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void __init do_parallel_initcalls(unsigned int level)
+{
+	struct parallel_initcall **p, **q;
+	struct task_struct **threads = NULL;
+	unsigned int i, nr_threads = 0;
+
+	parallel_initcall_head = NULL;
+	parallel_initcall_tail = &parallel_initcall_head;
+	parallel_initcall_left = 0;
+	parallel_initcall_running = 0;
+
+	for_each_parallel_initcall(p) {
+		struct parallel_initcall *call = *p;
+
+		if (call->level != level)
+			continue;
+		call->waiting = 0;
+		for_each_parallel_initcall(q) {
+			if (parallel_initcall_depends(call, *q)) {
+				if ((*q)->level == level)
+					call->waiting++;
+				else if ((*q)->level > level)
+					pr_warn("initcall %s: depends on %s "
+						"of a later level\n",
+						call->name, (*q)->name);
+			}
+		}
+		if (!call->waiting)
+			parallel_initcall_queue(call);
+		parallel_initcall_left++;
+	}
+	if (!parallel_initcall_left)
+		return;
+
+	if (initcall_parallel)
+		nr_threads = min(num_online_cpus(), parallel_initcall_left) - 1;
+	if (nr_threads)
+		threads = kcalloc(nr_threads, sizeof(*threads), GFP_KERNEL);
+	for (i = 0; threads && i < nr_threads; i++) {
+		threads[i] = kthread_run(parallel_initcall_thread,
+					 (void *)(unsigned long)level,
+					 "initcall/%u", i);
+		if (IS_ERR(threads[i]))
+			threads[i] = NULL;
+	}
+
+	parallel_initcall_worker(level);
+
+	for (i = 0; threads && i < nr_threads; i++)
+		if (threads[i])
+			kthread_stop(threads[i]);
+	kfree(threads);
+}
+
+static void __init do_initcall_level(unsigned int level)
 {
 	initcall_t *fn;
 
-	for (fn = __early_initcall_end; fn < __initcall_end; fn++)
+	for (fn = initcall_levels[level]; fn < initcall_sync_levels[level]; fn++)
+		do_one_initcall(*fn);
+
+	do_parallel_initcalls(level);
+
+	for (fn = initcall_sync_levels[level]; fn < initcall_levels[level + 1]; fn++)
 		do_one_initcall(*fn);
 }
 
+static void __init do_initcalls(void)
+{
+	unsigned int level;
+
+	for (level = 0; level < ARRAY_SIZE(initcall_sync_levels); level++)
+		do_initcall_level(level);
+}
+
 /*
  * Ok, the machine is now initialized. None of the devices
  * have been touched yet, but the CPU subsystem is up and
@@ -809,6 +1031,8 @@ static int __init kernel_init(void * unused)
 	smp_init();
 	sched_init_smp();
 
+	page_alloc_init_late();
+
 	do_basic_setup();
 
 	/* Open the /dev/console on the rootfs, this should never fail */
@@ -42,11 +42,13 @@
  * - scalability:
  *   - all global variables are read-mostly.
  *   - semop() calls and semctl(RMID) are synchronized by RCU.
- *   - most operations do write operations (actually: spin_lock calls) to
- *     the per-semaphore array structure.
- *   Thus: Perfect SMP scaling between independent semaphore arrays.
- *         If multiple semaphores in one array are used, then cache line
- *         trashing on the semaphore array spinlock will limit the scaling.
+ *   - semop() calls that operate on a single semaphore only take the
+ *     spinlock of that semaphore, everything else takes the spinlock of
+ *     the semaphore array and waits until no semaphore spinlock is held.
+ *     (see sem_lock_ops())
+ *   Thus: Perfect SMP scaling between independent semaphore arrays, and
+ *         between tasks that operate on different semaphores of one array
+ *         one semaphore at a time.
  * - semncnt and semzcnt are calculated on demand in count_semncnt() and
  *   count_semzcnt()
  * - the task that performs a successful semop() scans the list of all
@@ -67,9 +69,10 @@
  *   semaphore array, lazily allocated). For backwards compatibility, multiple
  *   modes for the UNDO variables are supported (per process, per thread)
  *   (see copy_semundo, CLONE_SYSVSEM)
- * - There are two lists of the pending operations: a per-array list
- *   and per-semaphore list (stored in the array). This allows to achieve FIFO
- *   ordering without always scanning all pending operations.
+ * - There are two kinds of lists of the pending operations: a per-array
+ *   list for operations on several semaphores and a per-semaphore list
+ *   (stored in the array) for operations on a single semaphore. The
+ *   ordering is FIFO within each list, but not between the lists.
  *   The worst-case behavior is nevertheless O(N^2) for N wakeups.
  */
 
@@ -94,12 +97,14 @@
 struct sem {
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
+	spinlock_t	lock;	/* for single-sop operations */
 	struct list_head sem_pending; /* pending single-sop operations */
-};
+	time_t	sem_otime;	/* last semop time, see get_semotime() */
+} ____cacheline_aligned_in_smp;
 
 /* One queue for each sleeping process in the system. */
 struct sem_queue {
-	struct list_head	simple_list; /* queue of pending operations */
+	struct list_head	simple_list; /* list of tasks to wake up */
 	struct list_head	list;	 /* queue of pending operations */
 	struct task_struct	*sleeper; /* this process */
 	struct sem_undo		*undo;	 /* undo structure */
@@ -239,6 +244,113 @@ static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
 	ipc_rmid(&sem_ids(ns), &s->sem_perm);
 }
 
+/*
+ * Called with rcu_read_lock() held; the array is not locked, and may
+ * already be marked as deleted.
+ */
+static inline struct sem_array *sem_obtain_object_check(struct ipc_namespace *ns,
+							int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	return container_of(ipcp, struct sem_array, sem_perm);
+}
+
+/*
+ * Wait until the single-sop operations in progress on the array have
+ * dropped their semaphore spinlock. Must be called with the array lock
+ * held, before touching any semaphore.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	/*
+	 * Whoever made complex_count nonzero has waited already, and no
+	 * single-sop operation takes its semaphore lock while it stays so.
+	 */
+	if (sma->complex_count)
+		return;
+
+	/* pairs with the smp_mb() in sem_lock_ops() */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	smp_rmb();
+}
+
+/*
+ * sem_lock_ops - lock a semaphore array for the operations @sops
+ *
+ * An operation on a single semaphore only takes the spinlock of that
+ * semaphore, unless operations on several semaphores are pending or
+ * someone holds the array lock. Then, and for all other operations, the
+ * array lock is taken and sem_wait_array() called.
+ * Returns the number of the semaphore locked, or -1 for the array lock.
+ * Must be called with rcu_read_lock() held.
+ */
+static int sem_lock_ops(struct sem_array *sma, struct sembuf *sops, int nsops)
+{
+	struct sem *sem;
+
+	if (nsops != 1) {
+		spin_lock(&sma->sem_perm.lock);
+		sem_wait_array(sma);
+		return -1;
+	}
+
+	sem = sma->sem_base + sops->sem_num;
+
+	if (sma->complex_count == 0) {
+		spin_lock(&sem->lock);
+		/* pairs with the smp_mb() in sem_wait_array() */
+		smp_mb();
+		if (!spin_is_locked(&sma->sem_perm.lock)) {
+			/*
+			 * complex_count only changes under the array lock,
+			 * and cannot become nonzero while we hold sem->lock.
+			 */
+			smp_rmb();
+			if (sma->complex_count == 0)
+				return sops->sem_num;
+		}
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	if (sma->complex_count == 0) {
+		/* the array lock holder is gone: back to the semaphore lock */
+		spin_lock(&sem->lock);
+		spin_unlock(&sma->sem_perm.lock);
+		return sops->sem_num;
+	}
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void sem_unlock_ops(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+}
+
+/* The last semop time of the array: the latest one of its semaphores. */
+static time_t get_semotime(struct sem_array *sma)
+{
+	time_t res = 0;
+	int i;
+
+	for (i = 0; i < sma->sem_nsems; i++)
+		if (sma->sem_base[i].sem_otime > res)
+			res = sma->sem_base[i].sem_otime;
+	return res;
+}
+
 /*
  * Lockless wakeup algorithm:
  * Without the check/retry algorithm a lockless wakeup is possible:
@@ -324,8 +436,10 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 
 	sma->sem_base = (struct sem *) &sma[1];
 
-	for (i = 0; i < nsems; i++)
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
 		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
 
 	sma->complex_count = 0;
 	INIT_LIST_HEAD(&sma->sem_pending);
@@ -502,9 +616,7 @@ static void wake_up_sem_queue_do(struct list_head *pt)
 static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
 {
 	list_del(&q->list);
-	if (q->nsops == 1)
-		list_del(&q->simple_list);
-	else
+	if (q->nsops > 1)
 		sma->complex_count--;
 }
 
@@ -559,7 +671,7 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
 	 * semval is 0. Check if there are wait-for-zero semops.
 	 * They must be the first entries in the per-semaphore simple queue
 	 */
-	h = list_first_entry(&curr->sem_pending, struct sem_queue, simple_list);
+	h = list_first_entry(&curr->sem_pending, struct sem_queue, list);
 	BUG_ON(h->nsops != 1);
 	BUG_ON(h->sops[0].sem_num != q->sops[0].sem_num);
 
@@ -579,8 +691,9 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
  * @pt: list head for the tasks that must be woken up.
  *
  * update_queue must be called after a semaphore in a semaphore array
- * was modified. If multiple semaphore were modified, then @semnum
- * must be set to -1.
+ * was modified. With @semnum set to -1, the pending operations on
+ * several semaphores are scanned, otherwise the pending single-sop
+ * operations on semaphore @semnum.
  * The tasks that must be woken up are added to @pt. The return code
  * is stored in q->pid.
  * The function return 1 if at least one semop was completed successfully.
@@ -590,30 +703,19 @@ static int update_queue(struct sem_array *sma, int semnum, struct list_head *pt)
 	struct sem_queue *q;
 	struct list_head *walk;
 	struct list_head *pending_list;
-	int offset;
 	int semop_completed = 0;
 
-	/* if there are complex operations around, then knowing the semaphore
-	 * that was modified doesn't help us. Assume that multiple semaphores
-	 * were modified.
-	 */
-	if (sma->complex_count)
-		semnum = -1;
-
-	if (semnum == -1) {
+	if (semnum == -1)
 		pending_list = &sma->sem_pending;
-		offset = offsetof(struct sem_queue, list);
-	} else {
+	else
 		pending_list = &sma->sem_base[semnum].sem_pending;
-		offset = offsetof(struct sem_queue, simple_list);
-	}
 
 again:
 	walk = pending_list->next;
 	while (walk != pending_list) {
 		int error, restart;
 
-		q = (struct sem_queue *)((char *)walk - offset);
+		q = list_entry(walk, struct sem_queue, list);
 		walk = walk->next;
 
 		/* If we are scanning the single sop, per-semaphore list of
@@ -667,11 +769,21 @@ again:
 static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsops,
 			int otime, struct list_head *pt)
 {
-	int i;
+	int i, progress;
 
 	if (sma->complex_count || sops == NULL) {
-		if (update_queue(sma, -1, pt))
-			otime = 1;
+		/*
+		 * Completing an operation on several semaphores can allow
+		 * single-sop ones to proceed and vice versa: rescan all the
+		 * lists until nothing completes anymore.
+		 */
+		do {
+			progress = update_queue(sma, -1, pt);
+			for (i = 0; i < sma->sem_nsems; i++)
+				progress |= update_queue(sma, i, pt);
+			if (progress)
+				otime = 1;
+		} while (progress && sma->complex_count);
 		goto done;
 	}
 
@@ -683,8 +795,13 @@ static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsop
 				otime = 1;
 	}
 done:
-	if (otime)
-		sma->sem_otime = get_seconds();
+	/* only the semaphore we hold the lock of, see get_semotime() */
+	if (otime) {
+		if (sops == NULL)
+			sma->sem_base[0].sem_otime = get_seconds();
+		else
+			sma->sem_base[sops[0].sem_num].sem_otime = get_seconds();
+	}
 }
 
 
@@ -703,6 +820,11 @@ static int count_semncnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semncnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sops = q->sops;
+		if ((sops->sem_op < 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semncnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -722,6 +844,11 @@ static int count_semzcnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semzcnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sops = q->sops;
+		if ((sops->sem_op == 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semzcnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -745,9 +872,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
 	struct list_head tasks;
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_wait_array(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -763,6 +892,14 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 		unlink_queue(sma, q);
 		wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
 	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+		}
+	}
 
 	/* Remove the semaphore set from the IDR */
 	sem_rmid(ns, sma);
@@ -867,7 +1004,7 @@ static int semctl_nolock(struct ipc_namespace *ns, int semid,
 		memset(&tbuf, 0, sizeof(tbuf));
 
 		kernel_to_ipc64_perm(&sma->sem_perm, &tbuf.sem_perm);
-		tbuf.sem_otime  = sma->sem_otime;
+		tbuf.sem_otime  = get_semotime(sma);
 		tbuf.sem_ctime  = sma->sem_ctime;
 		tbuf.sem_nsems  = sma->sem_nsems;
 		sem_unlock(sma);
@@ -897,6 +1034,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 	sma = sem_lock_check(ns, semid);
 	if (IS_ERR(sma))
 		return PTR_ERR(sma);
+	sem_wait_array(sma);
 
 	INIT_LIST_HEAD(&tasks);
 	nsems = sma->sem_nsems;
@@ -932,6 +1070,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 				err = -EIDRM;
 				goto out_free;
 			}
+			sem_wait_array(sma);
 		}
 
 		for (i = 0; i < sma->sem_nsems; i++)
@@ -976,6 +1115,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 			err = -EIDRM;
 			goto out_free;
 		}
+		sem_wait_array(sma);
 
 		for (i = 0; i < nsems; i++)
 			sma->sem_base[i].semval = sem_io[i];
@@ -1340,6 +1480,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
 	struct list_head tasks;
+	int locknum;
 
 	ns = current->nsproxy->ipc_ns;
 
@@ -1380,51 +1521,46 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	}
 
 	if (undos) {
+		/* on success, find_alloc_undo() returns in rcu_read_lock() */
 		un = find_alloc_undo(ns, semid);
 		if (IS_ERR(un)) {
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
 	INIT_LIST_HEAD(&tasks);
 
-	sma = sem_lock_check(ns, semid);
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
+		rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
+	error = -EFBIG;
+	if (max >= sma->sem_nsems) {
+		rcu_read_unlock();
+		goto out_free;
+	}
+
+	locknum = sem_lock_ops(sma, sops, nsops);
+
 	/*
-	 * semid identifiers are not unique - find_alloc_undo may have
+	 * The array may have been removed before we got the lock.
+	 * And semid identifiers are not unique - find_alloc_undo may have
 	 * allocated an undo structure, it was invalidated by an RMID
 	 * and now a new array with received the same id. Check and fail.
 	 * This case can be detected checking un->semid. The existence of
-	 * "un" itself is guaranteed by rcu.
+	 * "un" itself is guaranteed by rcu, and once the lock is held,
+	 * IPC_RMID is impossible; exit_sem is impossible, it always
+	 * operates on current (or a dead task).
 	 */
 	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
-	}
-
-	error = -EFBIG;
-	if (max >= sma->sem_nsems)
+	if (sma->sem_perm.deleted || (un && un->semid == -1))
 		goto out_unlock_free;
 
 	error = -EACCES;
@@ -1452,21 +1588,20 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
 
 	if (nsops == 1) {
 		struct sem *curr;
 		curr = &sma->sem_base[sops->sem_num];
 
 		if (alter)
-			list_add_tail(&queue.simple_list, &curr->sem_pending);
+			list_add_tail(&queue.list, &curr->sem_pending);
 		else
-			list_add(&queue.simple_list, &curr->sem_pending);
+			list_add(&queue.list, &curr->sem_pending);
 	} else {
-		INIT_LIST_HEAD(&queue.simple_list);
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
 		sma->complex_count++;
 	}
 
@@ -1475,7 +1610,8 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 sleep_again:
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1497,7 +1633,15 @@ sleep_again:
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
+	if (!IS_ERR(sma)) {
+		locknum = sem_lock_ops(sma, sops, nsops);
+		if (sma->sem_perm.deleted) {
+			sem_unlock_ops(sma, locknum);
+			sma = ERR_PTR(-EIDRM);
+		}
+	}
 
 	/*
 	 * Wait until it's guaranteed that no wakeup_sem_queue_do() is ongoing.
@@ -1508,6 +1652,7 @@ sleep_again:
 	 * Array removed? If yes, leave without sem_unlock().
 	 */
 	if (IS_ERR(sma)) {
+		rcu_read_unlock();
 		goto out_free;
 	}
 
@@ -1536,7 +1681,8 @@ sleep_again:
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
+	rcu_read_unlock();
 
 	wake_up_sem_queue_do(&tasks);
 out_free:
@@ -1620,6 +1766,7 @@ void exit_sem(struct task_struct *tsk)
 		/* exit_sem raced with IPC_RMID, nothing to do */
 		if (IS_ERR(sma))
 			continue;
+		sem_wait_array(sma);
 
 		un = __lookup_undo(ulp, semid);
 		if (un == NULL) {
@@ -1689,7 +1836,7 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it)
 			  sma->sem_perm.gid,
 			  sma->sem_perm.cuid,
 			  sma->sem_perm.cgid,
-			  sma->sem_otime,
+			  get_semotime(sma),
 			  sma->sem_ctime);
 }
 #endif
@@ -707,6 +707,28 @@ struct kern_ipc_perm *ipc_lock(struct ipc_ids *ids, int id)
 	return out;
 }
 
+/**
+ * ipc_obtain_object_check - Look up an ipc structure without locking it
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Like ipc_lock_check(), but leaves the locking to the caller, who must
+ * hold rcu_read_lock() and check ->deleted once the object is locked.
+ */
+struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out;
+
+	out = idr_find(&ids->ipcs_idr, ipcid_to_idx(id));
+	if (out == NULL)
+		return ERR_PTR(-EINVAL);
+
+	if (ipc_checkid(out, id))
+		return ERR_PTR(-EIDRM);
+
+	return out;
+}
+
 struct kern_ipc_perm *ipc_lock_check(struct ipc_ids *ids, int id)
 {
 	struct kern_ipc_perm *out;
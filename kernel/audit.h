@@ -57,8 +57,26 @@ struct audit_entry {
 	struct list_head	list;
 	struct rcu_head		rcu;
 	struct audit_krule	rule;
+	struct audit_rule_node	*nodes;		/* syscall index, exit list only */
+	int			nr_nodes;
 };
 
+/* Exit list rules are also hashed by syscall number, so that a syscall
+ * only looks at the rules it can match.  Rules naming more syscalls than
+ * AUDIT_SYSCALL_WIDE go on audit_syscall_wide_rules instead.  Each chain
+ * is kept in decreasing rule priority, i.e. in filter list order. */
+struct audit_rule_node {
+	struct hlist_node	list;
+	struct audit_entry	*entry;
+	u32			arch;		/* 0 if any */
+};
+
+#define AUDIT_SYSCALL_BUCKETS	(AUDIT_BITMASK_SIZE * 32)
+#define AUDIT_SYSCALL_WIDE	32
+extern struct hlist_head audit_syscall_rules[AUDIT_SYSCALL_BUCKETS];
+extern struct hlist_head audit_syscall_wide_rules;
+extern void audit_unhash_rule(struct audit_entry *e);
+
 #ifdef CONFIG_AUDIT
 extern int audit_enabled;
 extern int audit_ever_enabled;
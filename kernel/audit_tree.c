@@ -470,6 +470,7 @@ static void kill_rules(struct audit_tree *tree)
 			audit_log_format(ab, " list=%d res=1", rule->listnr);
 			audit_log_end(ab);
 			rule->tree = NULL;
+			audit_unhash_rule(entry);
 			list_del_rcu(&entry->list);
 			list_del(&entry->rule.list);
 			call_rcu(&entry->rcu, audit_free_rule_rcu);
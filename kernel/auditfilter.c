@@ -65,6 +65,10 @@ static struct list_head audit_rules_list[AUDIT_NR_FILTERS] = {
 	LIST_HEAD_INIT(audit_rules_list[5]),
 };
 
+/* Syscall index of audit_filter_list[AUDIT_FILTER_EXIT], see audit.h */
+struct hlist_head audit_syscall_rules[AUDIT_SYSCALL_BUCKETS];
+struct hlist_head audit_syscall_wide_rules;
+
 DEFINE_MUTEX(audit_filter_mutex);
 
 static inline void audit_free_rule(struct audit_entry *e)
@@ -83,6 +87,7 @@ static inline void audit_free_rule(struct audit_entry *e)
 		}
 	kfree(erule->fields);
 	kfree(erule->filterkey);
+	kfree(e->nodes);
 	kfree(e);
 }
 
@@ -866,6 +871,105 @@ out:
 static u64 prio_low = ~0ULL/2;
 static u64 prio_high = ~0ULL/2 - 1;
 
+/* Rules which go on audit_filter_list[AUDIT_FILTER_EXIT] itself, rather
+ * than on audit_inode_hash, are also put in the syscall index. */
+static inline int audit_rule_hashed(struct audit_krule *rule)
+{
+	return rule->listnr == AUDIT_FILTER_EXIT &&
+	       !rule->inode_f && !rule->watch;
+}
+
+static int audit_rule_syscalls(struct audit_krule *rule)
+{
+	int i, n = 0;
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		n += hweight32(rule->mask[i]);
+	return n;
+}
+
+static int audit_alloc_rule_nodes(struct audit_entry *entry)
+{
+	struct audit_field *arch = entry->rule.arch_f;
+	int i, n;
+
+	n = audit_rule_syscalls(&entry->rule);
+	if (!n)
+		return 0;
+	if (n > AUDIT_SYSCALL_WIDE)
+		n = 1;
+
+	entry->nodes = kcalloc(n, sizeof(*entry->nodes), GFP_KERNEL);
+	if (!entry->nodes)
+		return -ENOMEM;
+	entry->nr_nodes = n;
+	for (i = 0; i < n; i++) {
+		entry->nodes[i].entry = entry;
+		if (arch && arch->op == Audit_equal)
+			entry->nodes[i].arch = arch->val;
+	}
+	return 0;
+}
+
+static void audit_hash_node(struct audit_rule_node *node,
+			    struct hlist_head *head, int prepend)
+{
+	struct hlist_node *last;
+
+	if (prepend || hlist_empty(head)) {
+		hlist_add_head_rcu(&node->list, head);
+		return;
+	}
+	for (last = head->first; last->next; last = last->next)
+		;
+	hlist_add_after_rcu(last, &node->list);
+}
+
+/* Caller must hold audit_filter_mutex. */
+static void audit_hash_rule(struct audit_entry *entry, int prepend)
+{
+	int i, n = 0;
+
+	if (!entry->nr_nodes)
+		return;
+	if (audit_rule_syscalls(&entry->rule) > AUDIT_SYSCALL_WIDE) {
+		audit_hash_node(&entry->nodes[0], &audit_syscall_wide_rules,
+				prepend);
+		return;
+	}
+	for (i = 0; i < AUDIT_SYSCALL_BUCKETS && n < entry->nr_nodes; i++) {
+		if (!(entry->rule.mask[AUDIT_WORD(i)] & AUDIT_BIT(i)))
+			continue;
+		audit_hash_node(&entry->nodes[n++], &audit_syscall_rules[i],
+				prepend);
+	}
+}
+
+/* Hand the index nodes of a rule over to its replacement, which takes its
+ * place in the index as it does in the filter list.
+ * Caller must hold audit_filter_mutex. */
+static void audit_move_rule_nodes(struct audit_entry *old,
+				  struct audit_entry *new)
+{
+	int i;
+
+	for (i = 0; i < old->nr_nodes; i++)
+		rcu_assign_pointer(old->nodes[i].entry, new);
+	new->nodes = old->nodes;
+	new->nr_nodes = old->nr_nodes;
+	old->nodes = NULL;
+	old->nr_nodes = 0;
+}
+
+/* Caller must hold audit_filter_mutex. */
+void audit_unhash_rule(struct audit_entry *e)
+{
+	int i;
+
+	for (i = 0; i < e->nr_nodes; i++)
+		hlist_del_rcu(&e->nodes[i].list);
+}
+
 /* Add rule to given filterlist if not a duplicate. */
 static inline int audit_add_rule(struct audit_entry *entry)
 {
@@ -883,6 +987,15 @@ static inline int audit_add_rule(struct audit_entry *entry)
 		dont_count = 1;
 #endif
 
+	if (audit_rule_hashed(&entry->rule)) {
+		err = audit_alloc_rule_nodes(entry);
+		if (err) {
+			if (tree)
+				audit_put_tree(tree);
+			goto error;
+		}
+	}
+
 	mutex_lock(&audit_filter_mutex);
 	e = audit_find_rule(entry, &list);
 	if (e) {
@@ -922,11 +1035,13 @@ static inline int audit_add_rule(struct audit_entry *entry)
 		list_add(&entry->rule.list,
 			 &audit_rules_list[entry->rule.listnr]);
 		list_add_rcu(&entry->list, list);
+		audit_hash_rule(entry, 1);
 		entry->rule.flags &= ~AUDIT_FILTER_PREPEND;
 	} else {
 		list_add_tail(&entry->rule.list,
 			      &audit_rules_list[entry->rule.listnr]);
 		list_add_tail_rcu(&entry->list, list);
+		audit_hash_rule(entry, 0);
 	}
 #ifdef CONFIG_AUDITSYSCALL
 	if (!dont_count)
@@ -976,6 +1091,7 @@ static inline int audit_del_rule(struct audit_entry *entry)
 	if (e->rule.tree)
 		audit_remove_tree_rule(&e->rule);
 
+	audit_unhash_rule(e);
 	list_del_rcu(&e->list);
 	list_del(&e->rule.list);
 	call_rcu(&e->rcu, audit_free_rule_rcu);
@@ -1351,6 +1467,7 @@ static int update_lsm_rule(struct audit_krule *r)
 		audit_panic("error updating LSM filters");
 		if (r->watch)
 			list_del(&r->rlist);
+		audit_unhash_rule(entry);
 		list_del_rcu(&entry->list);
 		list_del(&r->list);
 	} else {
@@ -1358,6 +1475,7 @@ static int update_lsm_rule(struct audit_krule *r)
 			list_replace_init(&r->rlist, &nentry->rule.rlist);
 		list_replace_rcu(&entry->list, &nentry->list);
 		list_replace(&r->list, &nentry->rule.list);
+		audit_move_rule_nodes(entry, nentry);
 	}
 	call_rcu(&entry->rcu, audit_free_rule_rcu);
 
@@ -902,6 +902,65 @@ static enum audit_state audit_filter_syscall(struct task_struct *tsk,
 	return AUDIT_BUILD_CONTEXT;
 }
 
+static inline struct audit_rule_node *audit_rule_node(struct hlist_node *n)
+{
+	return n ? hlist_entry(n, struct audit_rule_node, list) : NULL;
+}
+
+#define first_rule_node(head) \
+	audit_rule_node(rcu_dereference(hlist_first_rcu(head)))
+#define next_rule_node(node) \
+	audit_rule_node(rcu_dereference(hlist_next_rcu(&(node)->list)))
+
+/* At syscall exit time, the exit list is filtered through its syscall
+ * index: only the rules hashed under this syscall and the wide ones are
+ * looked at.  Both chains are walked in filter list order, merged by
+ * priority, so the first match is the one audit_filter_syscall() would
+ * have found.  Once the remaining rules cannot beat ctx->prio, they
+ * cannot match either.
+ */
+static enum audit_state audit_filter_syscall_exit(struct task_struct *tsk,
+						  struct audit_context *ctx)
+{
+	struct audit_rule_node *b = NULL, *w, *n;
+	struct audit_entry *e;
+	enum audit_state state;
+	int word = AUDIT_WORD(ctx->major);
+	int bit  = AUDIT_BIT(ctx->major);
+
+	if (audit_pid && tsk->tgid == audit_pid)
+		return AUDIT_DISABLED;
+
+	rcu_read_lock();
+	if (ctx->major < AUDIT_SYSCALL_BUCKETS)
+		b = first_rule_node(&audit_syscall_rules[ctx->major]);
+	w = first_rule_node(&audit_syscall_wide_rules);
+	while (b || w) {
+		if (!w || (b && rcu_dereference(b->entry)->rule.prio >
+				rcu_dereference(w->entry)->rule.prio)) {
+			n = b;
+			b = next_rule_node(b);
+		} else {
+			n = w;
+			w = next_rule_node(w);
+		}
+		e = rcu_dereference(n->entry);
+		if (e->rule.prio <= ctx->prio)
+			break;
+		if (n->arch && n->arch != ctx->arch)
+			continue;
+		if ((e->rule.mask[word] & bit) == bit &&
+		    audit_filter_rules(tsk, &e->rule, ctx, NULL,
+				       &state, false)) {
+			rcu_read_unlock();
+			ctx->current_state = state;
+			return state;
+		}
+	}
+	rcu_read_unlock();
+	return AUDIT_BUILD_CONTEXT;
+}
+
 /*
  * Given an audit_name check the inode hash table to see if they match.
  * Called holding the rcu read lock to protect the use of audit_inode_hash
@@ -982,7 +1041,7 @@ static inline struct audit_context *audit_get_context(struct task_struct *tsk,
 		context->return_code  = return_code;
 
 	if (context->in_syscall && !context->dummy) {
-		audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_EXIT]);
+		audit_filter_syscall_exit(tsk, context);
 		audit_filter_inodes(tsk, context);
 	}
 
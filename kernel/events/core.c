@@ -28,6 +28,7 @@
 #include <linux/export.h>
 #include <linux/vmalloc.h>
 #include <linux/hardirq.h>
+#include <linux/tick.h>
 #include <linux/rculist.h>
 #include <linux/uaccess.h>
 #include <linux/syscalls.h>
@@ -640,8 +641,11 @@ static void perf_pmu_rotate_start(struct pmu *pmu)
 
 	WARN_ON(!irqs_disabled());
 
-	if (list_empty(&cpuctx->rotation_list))
+	if (list_empty(&cpuctx->rotation_list)) {
 		list_add(&cpuctx->rotation_list, head);
+		/* rotation is driven by the tick, which may be stopped */
+		tick_nohz_full_kick_cpu(smp_processor_id());
+	}
 }
 
 static void get_ctx(struct perf_event_context *ctx)
@@ -2485,6 +2489,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * The tick of a full dynticks CPU can only be stopped when no context
+ * on it needs rotation or frequency adjustment.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
@@ -51,6 +51,12 @@ extern const u16 kallsyms_token_index[] __attribute__((weak));
 
 extern const unsigned long kallsyms_markers[] __attribute__((weak));
 
+/* Symbol positions sorted by name, for binary searches on names */
+extern const unsigned int kallsyms_seqs_of_names[] __attribute__((weak));
+
+static bool kallsyms_use_index = true;
+module_param_named(index, kallsyms_use_index, bool, S_IRUGO | S_IWUSR);
+
 static inline int is_kernel_inittext(unsigned long addr)
 {
 	if (addr >= (unsigned long)_sinittext
@@ -168,6 +174,40 @@ static unsigned int get_symbol_offset(unsigned long pos)
 	return name - kallsyms_names;
 }
 
+/*
+ * Binary search the name index for @name. Symbols sharing a name are
+ * sorted by position, so the first one found is the one a linear scan
+ * would have found. Returns its position, or -1 if not found.
+ */
+static long kallsyms_lookup_index(const char *name)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long low, high, mid;
+	unsigned int seq;
+
+	low = 0;
+	high = kallsyms_num_syms;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		seq = kallsyms_seqs_of_names[mid];
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf);
+		if (strcmp(namebuf, name) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == kallsyms_num_syms)
+		return -1;
+
+	seq = kallsyms_seqs_of_names[low];
+	kallsyms_expand_symbol(get_symbol_offset(seq), namebuf);
+	if (strcmp(namebuf, name) == 0)
+		return seq;
+	return -1;
+}
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
@@ -175,6 +215,14 @@ unsigned long kallsyms_lookup_name(const char *name)
 	unsigned long i;
 	unsigned int off;
 
+	if (kallsyms_use_index && kallsyms_seqs_of_names) {
+		long pos = kallsyms_lookup_index(name);
+
+		if (pos >= 0)
+			return kallsyms_addresses[pos];
+		return module_kallsyms_lookup_name(name);
+	}
+
 	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
 		off = kallsyms_expand_symbol(off, namebuf);
 
@@ -58,6 +58,7 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/module.h>
@@ -232,6 +233,25 @@ extern const unsigned long __start___kcrctab_unused_gpl[];
 #define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
 #endif
 
+static const struct symsearch core_syms[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
 static bool each_symbol_in_section(const struct symsearch *arr,
 				   unsigned int arrsize,
 				   struct module *owner,
@@ -257,26 +277,9 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(core_syms, ARRAY_SIZE(core_syms), NULL,
+				   fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
@@ -384,6 +387,143 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * Symbols exported by modules are also hashed by name, so that resolving
+ * one does not mean searching the export tables of every loaded module in
+ * turn.  A module's entries are added under module_mutex as it goes on the
+ * module list and removed as it comes off it, so the chains can be walked
+ * with preempt disabled, like the list itself.
+ */
+#define MODSYM_HASH_BITS	10
+#define MODSYM_HASH_SIZE	(1 << MODSYM_HASH_BITS)
+
+#ifdef CONFIG_UNUSED_SYMBOLS
+#define MODULE_SYMTABS		5
+#else
+#define MODULE_SYMTABS		3
+#endif
+
+static struct hlist_head modsym_hash[MODSYM_HASH_SIZE];
+
+struct modsym {
+	struct hlist_node node;
+	struct module *owner;
+	const struct symsearch *syms;
+	unsigned int symnum;
+};
+
+struct module_symindex {
+	struct symsearch syms[MODULE_SYMTABS];
+	unsigned int num;
+	struct modsym entries[0];
+};
+
+static struct hlist_head *modsym_bucket(const char *name)
+{
+	return &modsym_hash[jhash(name, strlen(name), 0) &
+			    (MODSYM_HASH_SIZE - 1)];
+}
+
+/* Called once the export tables are relocated, before taking module_mutex. */
+static int module_symindex_alloc(struct module *mod)
+{
+	struct symsearch arr[MODULE_SYMTABS] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
+		  NOT_GPL_ONLY, false },
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
+		  GPL_ONLY, false },
+		{ mod->gpl_future_syms,
+		  mod->gpl_future_syms + mod->num_gpl_future_syms,
+		  mod->gpl_future_crcs,
+		  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+		{ mod->unused_syms,
+		  mod->unused_syms + mod->num_unused_syms,
+		  mod->unused_crcs,
+		  NOT_GPL_ONLY, true },
+		{ mod->unused_gpl_syms,
+		  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		  mod->unused_gpl_crcs,
+		  GPL_ONLY, true },
+#endif
+	};
+	struct module_symindex *idx;
+	unsigned int i, j, num = 0;
+
+	for (i = 0; i < MODULE_SYMTABS; i++)
+		num += arr[i].stop - arr[i].start;
+	if (!num)
+		return 0;
+
+	idx = kmalloc(sizeof(*idx) + num * sizeof(idx->entries[0]),
+		      GFP_KERNEL);
+	if (!idx)
+		return -ENOMEM;
+
+	memcpy(idx->syms, arr, sizeof(arr));
+	idx->num = 0;
+	for (i = 0; i < MODULE_SYMTABS; i++) {
+		for (j = 0; j < arr[i].stop - arr[i].start; j++) {
+			struct modsym *ms = &idx->entries[idx->num++];
+
+			ms->owner = mod;
+			ms->syms = &idx->syms[i];
+			ms->symnum = j;
+		}
+	}
+	mod->symindex = idx;
+	return 0;
+}
+
+/* Must hold module_mutex. */
+static void module_symindex_link(struct module *mod)
+{
+	struct module_symindex *idx = mod->symindex;
+	unsigned int i;
+
+	if (!idx)
+		return;
+	for (i = 0; i < idx->num; i++) {
+		struct modsym *ms = &idx->entries[i];
+
+		hlist_add_head_rcu(&ms->node,
+				   modsym_bucket(ms->syms->start[ms->symnum].name));
+	}
+}
+
+/* Must hold module_mutex, and wait for readers before freeing. */
+static void module_symindex_unlink(struct module *mod)
+{
+	struct module_symindex *idx = mod->symindex;
+	unsigned int i;
+
+	if (!idx)
+		return;
+	for (i = 0; i < idx->num; i++)
+		hlist_del_rcu(&idx->entries[i].node);
+}
+
+static bool find_core_symbol(struct find_symbol_arg *fsa)
+{
+	return each_symbol_in_section(core_syms, ARRAY_SIZE(core_syms), NULL,
+				      find_symbol_in_section, fsa);
+}
+
+static bool find_module_symbol(struct find_symbol_arg *fsa)
+{
+	struct modsym *ms;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(ms, pos, modsym_bucket(fsa->name), node) {
+		if (strcmp(ms->syms->start[ms->symnum].name, fsa->name) != 0)
+			continue;
+		if (check_symbol(ms->syms, ms->owner, ms->symnum, fsa))
+			return true;
+	}
+	return false;
+}
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -398,7 +538,7 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (find_core_symbol(&fsa) || find_module_symbol(&fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1172,18 +1312,36 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 						  const char *name,
 						  char ownername[])
 {
+	struct find_symbol_arg fsa;
 	struct module *owner;
 	const struct kernel_symbol *sym;
-	const unsigned long *crc;
 	int err;
 
+	fsa.name = name;
+	fsa.gplok = !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE));
+	fsa.warn = true;
+
+	/*
+	 * The kernel's own exports never go away and need no reference
+	 * taken on them, so most symbols resolve without module_mutex.
+	 */
+	if (find_core_symbol(&fsa)) {
+		strncpy(ownername, module_name(NULL), MODULE_NAME_LEN);
+		if (!check_version(info->sechdrs, info->index.vers, name, mod,
+				   fsa.crc, NULL))
+			return ERR_PTR(-EINVAL);
+		return fsa.sym;
+	}
+
 	mutex_lock(&module_mutex);
-	sym = find_symbol(name, &owner, &crc,
-			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
-	if (!sym)
+	if (!find_module_symbol(&fsa)) {
+		sym = NULL;
 		goto unlock;
+	}
+	sym = fsa.sym;
+	owner = fsa.owner;
 
-	if (!check_version(info->sechdrs, info->index.vers, name, mod, crc,
+	if (!check_version(info->sechdrs, info->index.vers, name, mod, fsa.crc,
 			   owner)) {
 		sym = ERR_PTR(-EINVAL);
 		goto getname;
@@ -1643,6 +1801,7 @@ static int __unlink_module(void *_mod)
 {
 	struct module *mod = _mod;
 	list_del(&mod->list);
+	module_symindex_unlink(mod);
 	module_bug_cleanup(mod);
 	return 0;
 }
@@ -1776,6 +1935,7 @@ static void free_module(struct module *mod)
 	mutex_lock(&module_mutex);
 	stop_machine(__unlink_module, mod, NULL);
 	mutex_unlock(&module_mutex);
+	kfree(mod->symindex);
 	mod_sysfs_teardown(mod);
 
 	/* Remove dynamic debug info */
@@ -2898,6 +3058,11 @@ static struct module *load_module(void __user *umod,
 		goto free_arch_cleanup;
 	}
 
+	/* Hash our exports while we are still outside module_mutex. */
+	err = module_symindex_alloc(mod);
+	if (err)
+		goto free_args;
+
 	/* Mark state as coming so strong_try_module_get() ignores us. */
 	mod->state = MODULE_STATE_COMING;
 
@@ -2923,6 +3088,7 @@ static struct module *load_module(void __user *umod,
 		goto ddebug;
 
 	module_bug_finalize(info.hdr, info.sechdrs, mod);
+	module_symindex_link(mod);
 	list_add_rcu(&mod->list, &modules);
 	mutex_unlock(&module_mutex);
 
@@ -2947,6 +3113,7 @@ static struct module *load_module(void __user *umod,
 	mutex_lock(&module_mutex);
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
+	module_symindex_unlink(mod);
 	module_bug_cleanup(mod);
 
  ddebug:
@@ -2954,6 +3121,8 @@ static struct module *load_module(void __user *umod,
  unlock:
 	mutex_unlock(&module_mutex);
 	synchronize_sched();
+	kfree(mod->symindex);
+ free_args:
 	kfree(mod->args);
  free_arch_cleanup:
 	module_arch_cleanup(mod);
@@ -41,6 +41,8 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 
@@ -96,22 +98,18 @@ EXPORT_SYMBOL_GPL(console_drivers);
 static int console_locked, console_suspended;
 
 /*
- * logbuf_lock protects log_buf, log_start, log_end, con_start and logged_chars
- * It is also used in interesting ways to provide interlocking in
- * console_unlock();.
+ * Once the system is up, console output is left to this thread so that
+ * printk() never has to wait for a slow console.
  */
-static DEFINE_RAW_SPINLOCK(logbuf_lock);
-
-#define LOG_BUF_MASK (log_buf_len-1)
-#define LOG_BUF(idx) (log_buf[(idx) & LOG_BUF_MASK])
+static struct task_struct *printk_thread;
 
 /*
- * The indices into log_buf are not constrained to log_buf_len - they
- * must be masked before subscripting
+ * Wakeups printk() could not do itself, they are done on the next tick.
  */
-static unsigned log_start;	/* Index into log_buf: next char to be read by syslog() */
-static unsigned con_start;	/* Index into log_buf: next char to be sent to consoles */
-static unsigned log_end;	/* Index into log_buf: most-recently-written-char + 1 */
+#define PRINTK_PENDING_WAKEUP	0x01	/* syslog readers */
+#define PRINTK_PENDING_CONSOLE	0x02	/* printk_thread */
+
+static DEFINE_PER_CPU(int, printk_pending);
 
 /*
  * If exclusive_console is non-NULL then only this console is to be printed to.
@@ -144,10 +142,71 @@ static int console_may_schedule;
 
 #ifdef CONFIG_PRINTK
 
-static char __log_buf[__LOG_BUF_LEN];
+/*
+ * The log buffer is a ring of variable length records: a struct log
+ * header followed by the text of one message.  Writers do not take any
+ * lock.  They reserve room by moving log_head forward with cmpxchg(),
+ * after pushing log_tail past the oldest records if the ring is full,
+ * and commit the record by storing its position in the header last.
+ * Readers copy a record out and then check against log_tail that it
+ * was not overwritten while they did.
+ *
+ * log_head and log_tail only ever grow, they have to be masked before
+ * indexing log_buf.  A record never wraps around the end of the ring:
+ * the room left there is filled with a LOG_PAD record, or skipped if
+ * it is too small to hold a header.
+ */
+enum log_flags {
+	LOG_PAD		= 1,	/* no message, skip to the next record */
+	LOG_CONT	= 2,	/* continues the line of the previous message */
+	LOG_NEWLINE	= 4,	/* ends its line */
+};
+
+struct log {
+	unsigned long pos;	/* position of the record, set on commit */
+	u64 ts_nsec;		/* timestamp in nanoseconds */
+	u16 len;		/* length of the whole record */
+	u16 text_len;		/* length of the message text */
+	u8 facility;		/* syslog facility */
+	u8 flags:5;		/* enum log_flags */
+	u8 level:3;		/* syslog level */
+};
+
+#define LOG_ALIGN	__alignof__(struct log)
+#define LOG_LINE_MAX	1024			/* longest message text */
+#define LOG_TEXT_MAX	(2 * LOG_LINE_MAX)	/* a message with its prefixes */
+#define LOG_SPIN_MAX	10000			/* wait for an uncommitted tail */
+
+#define LOG_BUF_MASK	(log_buf_len - 1)
+#define LOG_RECORD(pos)	((struct log *)(log_buf + ((pos) & LOG_BUF_MASK)))
+
+static char __log_buf[__LOG_BUF_LEN] __aligned(LOG_ALIGN);
 static char *log_buf = __log_buf;
 static int log_buf_len = __LOG_BUF_LEN;
-static unsigned logged_chars; /* Number of chars produced since last read+clear operation */
+static unsigned long log_head;	/* end of the last record reserved */
+static unsigned long log_tail;	/* start of the oldest record */
+
+/* Messages lost because the oldest record was still being written */
+static atomic_t log_dropped = ATOMIC_INIT(0);
+
+/* Whether the last message ended its line, and the level of that line */
+static bool log_prev_newline = true;
+static int log_prev_level;
+
+/*
+ * syslog_mutex protects syslog_pos, syslog_partial, syslog_newline and
+ * clear_pos.
+ */
+static DEFINE_MUTEX(syslog_mutex);
+static unsigned long syslog_pos;	/* next record to be read by syslog() */
+static size_t syslog_partial;		/* bytes of it already read */
+static bool syslog_newline = true;
+static unsigned long clear_pos;		/* first record after the last clear */
+
+/* Next record to be sent to the consoles, protected by console_sem */
+static unsigned long console_pos;
+static bool console_newline = true;
+
 static int saved_console_loglevel = -1;
 
 #ifdef CONFIG_KEXEC
@@ -162,12 +221,149 @@ static int saved_console_loglevel = -1;
 void log_buf_kexec_setup(void)
 {
 	VMCOREINFO_SYMBOL(log_buf);
-	VMCOREINFO_SYMBOL(log_end);
 	VMCOREINFO_SYMBOL(log_buf_len);
-	VMCOREINFO_SYMBOL(logged_chars);
+	VMCOREINFO_SYMBOL(log_head);
+	VMCOREINFO_SYMBOL(log_tail);
+	VMCOREINFO_STRUCT_SIZE(log);
+	VMCOREINFO_OFFSET(log, pos);
+	VMCOREINFO_OFFSET(log, ts_nsec);
+	VMCOREINFO_OFFSET(log, len);
+	VMCOREINFO_OFFSET(log, text_len);
 }
 #endif
 
+/* The end of the ring is skipped when there is no room left for a header */
+static inline unsigned long log_skip_gap(unsigned long pos)
+{
+	if ((pos & LOG_BUF_MASK) + sizeof(struct log) > log_buf_len)
+		return ALIGN(pos, log_buf_len);
+	return pos;
+}
+
+/*
+ * Push log_tail forward until the ring has room up to @next.  Fails if
+ * the oldest record is not committed after a while: its writer may be
+ * the very context we interrupted.
+ */
+static bool log_make_room(unsigned long next)
+{
+	unsigned long tail, pos;
+	struct log *msg;
+	int spins = 0;
+
+	for (;;) {
+		tail = ACCESS_ONCE(log_tail);
+		if ((long)(next - tail) <= log_buf_len)
+			return true;
+
+		pos = log_skip_gap(tail);
+		if (pos == tail) {
+			msg = LOG_RECORD(tail);
+			if (ACCESS_ONCE(msg->pos) != tail) {
+				if (++spins > LOG_SPIN_MAX)
+					return false;
+				cpu_relax();
+				continue;
+			}
+			smp_rmb();
+			pos = tail + msg->len;
+		}
+		cmpxchg(&log_tail, tail, pos);
+	}
+}
+
+/*
+ * Reserve a record for @text_len bytes of text, returns NULL if there is
+ * no room for it.  The caller fills it in and passes it to log_commit().
+ */
+static struct log *log_reserve(size_t text_len, unsigned long *ppos)
+{
+	unsigned long head, pos, next;
+	size_t len = ALIGN(sizeof(struct log) + text_len, LOG_ALIGN);
+	struct log *msg;
+
+	do {
+		head = ACCESS_ONCE(log_head);
+		pos = head;
+		if ((pos & LOG_BUF_MASK) + len > log_buf_len)
+			pos = ALIGN(pos, log_buf_len);
+		next = pos + len;
+		if (!log_make_room(next))
+			return NULL;
+	} while (cmpxchg(&log_head, head, next) != head);
+
+	if (pos - head >= sizeof(struct log)) {
+		msg = LOG_RECORD(head);
+		msg->len = pos - head;
+		msg->flags = LOG_PAD;
+		smp_wmb();
+		msg->pos = head;
+	}
+
+	msg = LOG_RECORD(pos);
+	msg->len = len;
+	*ppos = pos;
+	return msg;
+}
+
+static inline void log_commit(struct log *msg, unsigned long pos)
+{
+	smp_wmb();
+	msg->pos = pos;
+}
+
+/*
+ * Copy the first message at or after *@ppos into @msg, and its text into
+ * @text unless that is NULL, and move *@ppos past it.  Returns false if
+ * there is no committed message there yet.  If *@ppos had already been
+ * overwritten it starts over from the oldest record, and sets *@lost.
+ */
+static bool log_read(unsigned long *ppos, struct log *msg, char *text,
+		     bool *lost)
+{
+	unsigned long pos;
+	struct log *rec;
+
+again:
+	pos = *ppos;
+	if ((long)(pos - ACCESS_ONCE(log_tail)) < 0) {
+		pos = ACCESS_ONCE(log_tail);
+		if (lost)
+			*lost = true;
+	}
+	if (pos == ACCESS_ONCE(log_head))
+		return false;
+
+	pos = log_skip_gap(pos);
+	rec = LOG_RECORD(pos);
+	if (ACCESS_ONCE(rec->pos) != pos) {
+		if ((long)(pos - ACCESS_ONCE(log_tail)) < 0)
+			goto again;
+		return false;
+	}
+	smp_rmb();
+	*msg = *rec;
+	if (text && !(msg->flags & LOG_PAD))
+		memcpy(text, rec + 1, min_t(size_t, msg->text_len,
+					    LOG_LINE_MAX));
+	smp_rmb();
+	if ((long)(pos - ACCESS_ONCE(log_tail)) < 0)
+		goto again;
+
+	*ppos = pos + msg->len;
+	if (msg->flags & LOG_PAD)
+		goto again;
+	return true;
+}
+
+/* Is there a message at or after @pos ready to be read? */
+static bool log_pending(unsigned long pos)
+{
+	struct log msg;
+
+	return log_read(&pos, &msg, NULL, NULL);
+}
+
 /* requested log_buf_len from kernel cmdline */
 static unsigned long __initdata new_log_buf_len;
 
@@ -187,8 +383,10 @@ early_param("log_buf_len", log_buf_len_setup);
 
 void __init setup_log_buf(int early)
 {
-	unsigned long flags;
-	unsigned start, dest_idx, offset;
+	unsigned long flags, pos, head, new_console_pos = 0;
+	char *old_log_buf;
+	int old_log_buf_len;
+	bool console_mapped = false;
 	char *new_log_buf;
 	int free;
 
@@ -212,25 +410,54 @@ void __init setup_log_buf(int early)
 		return;
 	}
 
-	raw_spin_lock_irqsave(&logbuf_lock, flags);
-	log_buf_len = new_log_buf_len;
+	/*
+	 * This early there are no other CPUs printing yet, the records
+	 * are simply logged again in the new buffer.
+	 */
+	local_irq_save(flags);
+	old_log_buf = log_buf;
+	old_log_buf_len = log_buf_len;
+	pos = log_tail;
+	head = log_head;
+	free = __LOG_BUF_LEN - (head - pos);
+
 	log_buf = new_log_buf;
+	log_buf_len = new_log_buf_len;
+	log_head = log_tail = 0;
 	new_log_buf_len = 0;
-	free = __LOG_BUF_LEN - log_end;
 
-	offset = start = min(con_start, log_start);
-	dest_idx = 0;
-	while (start != log_end) {
-		unsigned log_idx_mask = start & (__LOG_BUF_LEN - 1);
+	while (pos != head) {
+		unsigned long offset = pos & (old_log_buf_len - 1);
+		struct log *old, *msg;
+		unsigned long new_pos;
+
+		if (!console_mapped && (long)(pos - console_pos) >= 0) {
+			new_console_pos = log_head;
+			console_mapped = true;
+		}
+		if (offset + sizeof(*old) > old_log_buf_len) {
+			pos = ALIGN(pos, old_log_buf_len);
+			continue;
+		}
+		old = (struct log *)(old_log_buf + offset);
+		pos += old->len;
+		if (old->flags & LOG_PAD)
+			continue;
 
-		log_buf[dest_idx] = __log_buf[log_idx_mask];
-		start++;
-		dest_idx++;
+		msg = log_reserve(old->text_len, &new_pos);
+		if (!msg)
+			continue;
+		msg->ts_nsec = old->ts_nsec;
+		msg->text_len = old->text_len;
+		msg->facility = old->facility;
+		msg->flags = old->flags;
+		msg->level = old->level;
+		memcpy(msg + 1, old + 1, old->text_len);
+		log_commit(msg, new_pos);
 	}
-	log_start -= offset;
-	con_start -= offset;
-	log_end -= offset;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+	console_pos = console_mapped ? new_console_pos : log_head;
+	syslog_pos = clear_pos = 0;
+	local_irq_restore(flags);
 
 	pr_info("log_buf_len: %d\n", log_buf_len);
 	pr_info("early log buf free: %d(%d%%)\n",
@@ -329,11 +556,217 @@ static int check_syslog_permissions(int type, bool from_file)
 	return 0;
 }
 
+#if defined(CONFIG_PRINTK_TIME)
+static bool printk_time = 1;
+#else
+static bool printk_time = 0;
+#endif
+module_param_named(time, printk_time, bool, S_IRUGO | S_IWUSR);
+
+static size_t print_prefix(const struct log *msg, bool syslog, char *buf,
+			   size_t size)
+{
+	size_t len = 0;
+
+	if (syslog)
+		len = scnprintf(buf, size, "<%u>",
+				(msg->facility << 3) | msg->level);
+
+	if (printk_time) {
+		u64 ts = msg->ts_nsec;
+		unsigned long rem_nsec = do_div(ts, 1000000000);
+
+		len += scnprintf(buf + len, size - len, "[%5lu.%06lu] ",
+				 (unsigned long)ts, rem_nsec / 1000);
+	}
+	return len;
+}
+
+/*
+ * Format a message as text, with the "<level>" syslog prefix on each of
+ * its lines if @syslog is set and with the timestamp if printk_time is.
+ * *@newline tracks whether the line of the previous message was ended,
+ * if not it is ended here unless this message continues it.
+ */
+static size_t log_render(const struct log *msg, const char *text, bool syslog,
+			 bool *newline, char *buf, size_t size)
+{
+	const char *end = text + min_t(size_t, msg->text_len, LOG_LINE_MAX);
+	size_t len = 0;
+
+	if (!(msg->flags & LOG_CONT)) {
+		if (!*newline && len < size)
+			buf[len++] = '\n';
+		len += print_prefix(msg, syslog, buf + len, size - len);
+	}
+
+	while (text < end && len < size) {
+		const char *nl = memchr(text, '\n', end - text);
+		size_t n = (nl ? nl + 1 : end) - text;
+
+		n = min(n, size - len);
+		memcpy(buf + len, text, n);
+		len += n;
+		text += n;
+		if (nl && text == nl + 1 && text < end)
+			len += print_prefix(msg, syslog, buf + len, size - len);
+	}
+
+	if ((msg->flags & LOG_NEWLINE) && len < size)
+		buf[len++] = '\n';
+	*newline = msg->flags & LOG_NEWLINE;
+	return len;
+}
+
+/*
+ * Return the position from @pos on after which the messages up to the
+ * newest one fit in @size bytes of syslog text, and in *@end where those
+ * stop.  @text and @line are scratch buffers for log_read() and
+ * log_render().
+ */
+static unsigned long log_fit(unsigned long pos, size_t size,
+			     unsigned long *end, char *text, char *line)
+{
+	unsigned long start = pos;
+	bool newline = true;
+	size_t total = 0;
+	struct log msg;
+
+	while (log_read(&pos, &msg, text, NULL))
+		total += log_render(&msg, text, true, &newline, line,
+				    LOG_TEXT_MAX);
+	*end = pos;
+
+	pos = start;
+	newline = true;
+	while (total > size && log_read(&pos, &msg, text, NULL))
+		total -= log_render(&msg, text, true, &newline, line,
+				    LOG_TEXT_MAX);
+	return pos;
+}
+
+/* Read syslog text from syslog_pos on, consuming it */
+static int syslog_print(char __user *buf, int size)
+{
+	char *text, *line;
+	struct log msg;
+	int len = 0;
+
+	text = kmalloc(LOG_LINE_MAX + LOG_TEXT_MAX, GFP_KERNEL);
+	if (!text)
+		return -ENOMEM;
+	line = text + LOG_LINE_MAX;
+
+	mutex_lock(&syslog_mutex);
+	while (size > 0) {
+		unsigned long pos = syslog_pos;
+		size_t n, skip = syslog_partial;
+		bool newline, lost = false;
+
+		if (!log_read(&pos, &msg, text, &lost))
+			break;
+		if (lost) {
+			/* what was left of the message has been overwritten */
+			skip = 0;
+			syslog_newline = true;
+		}
+		newline = syslog_newline;
+		n = log_render(&msg, text, true, &newline, line, LOG_TEXT_MAX);
+		skip = min(skip, n);
+		n -= skip;
+
+		if (n > size) {
+			n = size;
+			syslog_pos = pos - msg.len;
+			syslog_partial = skip + n;
+		} else {
+			syslog_pos = pos;
+			syslog_partial = 0;
+			syslog_newline = newline;
+		}
+
+		if (copy_to_user(buf, line + skip, n)) {
+			if (!len)
+				len = -EFAULT;
+			break;
+		}
+		buf += n;
+		len += n;
+		size -= n;
+	}
+	mutex_unlock(&syslog_mutex);
+
+	kfree(text);
+	return len;
+}
+
+/* Read the newest syslog text that fits in @size, without consuming it */
+static int syslog_print_all(char __user *buf, int size, bool clear)
+{
+	unsigned long pos, end;
+	bool newline = true;
+	char *text, *line;
+	struct log msg;
+	int len = 0;
+
+	text = kmalloc(LOG_LINE_MAX + LOG_TEXT_MAX, GFP_KERNEL);
+	if (!text)
+		return -ENOMEM;
+	line = text + LOG_LINE_MAX;
+
+	mutex_lock(&syslog_mutex);
+	pos = log_fit(clear_pos, size, &end, text, line);
+	while ((long)(pos - end) < 0 && log_read(&pos, &msg, text, NULL)) {
+		size_t n;
+
+		n = log_render(&msg, text, true, &newline, line, LOG_TEXT_MAX);
+		if (len + n > size)
+			break;
+		if (copy_to_user(buf + len, line, n)) {
+			len = -EFAULT;
+			break;
+		}
+		len += n;
+		cond_resched();
+	}
+	if (clear)
+		clear_pos = end;
+	mutex_unlock(&syslog_mutex);
+
+	kfree(text);
+	return len;
+}
+
+/* Number of bytes syslog_print() has left to read */
+static int syslog_unread(void)
+{
+	unsigned long pos;
+	char *text, *line;
+	struct log msg;
+	bool newline;
+	size_t len = 0;
+
+	text = kmalloc(LOG_LINE_MAX + LOG_TEXT_MAX, GFP_KERNEL);
+	if (!text)
+		return -ENOMEM;
+	line = text + LOG_LINE_MAX;
+
+	mutex_lock(&syslog_mutex);
+	pos = syslog_pos;
+	newline = syslog_newline;
+	while (log_read(&pos, &msg, text, NULL))
+		len += log_render(&msg, text, true, &newline, line,
+				  LOG_TEXT_MAX);
+	len -= min(len, syslog_partial);
+	mutex_unlock(&syslog_mutex);
+
+	kfree(text);
+	return len;
+}
+
 int do_syslog(int type, char __user *buf, int len, bool from_file)
 {
-	unsigned i, j, limit, count;
-	int do_clear = 0;
-	char c;
+	bool clear = false;
 	int error;
 
 	error = check_syslog_permissions(type, from_file);
@@ -361,28 +794,14 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 			goto out;
 		}
 		error = wait_event_interruptible(log_wait,
-							(log_start - log_end));
+						 log_pending(syslog_pos));
 		if (error)
 			goto out;
-		i = 0;
-		raw_spin_lock_irq(&logbuf_lock);
-		while (!error && (log_start != log_end) && i < len) {
-			c = LOG_BUF(log_start);
-			log_start++;
-			raw_spin_unlock_irq(&logbuf_lock);
-			error = __put_user(c,buf);
-			buf++;
-			i++;
-			cond_resched();
-			raw_spin_lock_irq(&logbuf_lock);
-		}
-		raw_spin_unlock_irq(&logbuf_lock);
-		if (!error)
-			error = i;
+		error = syslog_print(buf, len);
 		break;
 	/* Read/clear last kernel messages */
 	case SYSLOG_ACTION_READ_CLEAR:
-		do_clear = 1;
+		clear = true;
 		/* FALL THRU */
 	/* Read last kernel messages */
 	case SYSLOG_ACTION_READ_ALL:
@@ -396,51 +815,13 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 			error = -EFAULT;
 			goto out;
 		}
-		count = len;
-		if (count > log_buf_len)
-			count = log_buf_len;
-		raw_spin_lock_irq(&logbuf_lock);
-		if (count > logged_chars)
-			count = logged_chars;
-		if (do_clear)
-			logged_chars = 0;
-		limit = log_end;
-		/*
-		 * __put_user() could sleep, and while we sleep
-		 * printk() could overwrite the messages
-		 * we try to copy to user space. Therefore
-		 * the messages are copied in reverse. <manfreds>
-		 */
-		for (i = 0; i < count && !error; i++) {
-			j = limit-1-i;
-			if (j + log_buf_len < log_end)
-				break;
-			c = LOG_BUF(j);
-			raw_spin_unlock_irq(&logbuf_lock);
-			error = __put_user(c,&buf[count-1-i]);
-			cond_resched();
-			raw_spin_lock_irq(&logbuf_lock);
-		}
-		raw_spin_unlock_irq(&logbuf_lock);
-		if (error)
-			break;
-		error = i;
-		if (i != count) {
-			int offset = count-error;
-			/* buffer overflow during copy, correct user buffer. */
-			for (i = 0; i < error; i++) {
-				if (__get_user(c,&buf[i+offset]) ||
-				    __put_user(c,&buf[i])) {
-					error = -EFAULT;
-					break;
-				}
-				cond_resched();
-			}
-		}
+		error = syslog_print_all(buf, len, clear);
 		break;
 	/* Clear ring buffer */
 	case SYSLOG_ACTION_CLEAR:
-		logged_chars = 0;
+		mutex_lock(&syslog_mutex);
+		clear_pos = ACCESS_ONCE(log_head);
+		mutex_unlock(&syslog_mutex);
 		break;
 	/* Disable logging to console */
 	case SYSLOG_ACTION_CONSOLE_OFF:
@@ -469,7 +850,7 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		break;
 	/* Number of chars in the log buffer */
 	case SYSLOG_ACTION_SIZE_UNREAD:
-		error = log_end - log_start;
+		error = syslog_unread();
 		break;
 	/* Size of the log buffer */
 	case SYSLOG_ACTION_SIZE_BUFFER:
@@ -488,26 +869,74 @@ SYSCALL_DEFINE3(syslog, int, type, char __user *, buf, int, len)
 	return do_syslog(type, buf, len, SYSLOG_FROM_CALL);
 }
 
+/*
+ * kmsg_dump() and kdb cannot allocate memory when they need it, so the
+ * log is rendered into this buffer for them.  Its tail holds the scratch
+ * buffers for log_read() and log_render().
+ */
+static char *dump_buf;
+static size_t dump_buf_len;
+static unsigned long dump_busy;
+
+static int dump_buf_alloc(void)
+{
+	char *buf;
+
+	if (dump_buf)
+		return 0;
+
+	buf = vmalloc(log_buf_len + LOG_LINE_MAX + LOG_TEXT_MAX);
+	if (!buf)
+		return -ENOMEM;
+	dump_buf_len = log_buf_len;
+	if (cmpxchg(&dump_buf, NULL, buf))
+		vfree(buf);
+	return 0;
+}
+
+/* Render the newest messages that fit into dump_buf, returns the length */
+static size_t log_dump(void)
+{
+	char *text = dump_buf + dump_buf_len, *line = text + LOG_LINE_MAX;
+	unsigned long pos, end;
+	bool newline = true;
+	struct log msg;
+	size_t len = 0;
+
+	pos = log_fit(ACCESS_ONCE(log_tail), dump_buf_len, &end, text, line);
+	while ((long)(pos - end) < 0 && log_read(&pos, &msg, text, NULL))
+		len += log_render(&msg, text, true, &newline, dump_buf + len,
+				  dump_buf_len - len);
+	return len;
+}
+
 #ifdef	CONFIG_KGDB_KDB
 /* kdb dmesg command needs access to the syslog buffer.  do_syslog()
- * uses locks so it cannot be used during debugging.  Just tell kdb
- * where the start and end of the physical and logical logs are.  This
- * is equivalent to do_syslog(3).
+ * uses locks so it cannot be used during debugging.  Render the log
+ * and tell kdb where the start and end of the physical and logical
+ * logs are.  This is equivalent to do_syslog(3).
  */
 void kdb_syslog_data(char *syslog_data[4])
 {
-	syslog_data[0] = log_buf;
-	syslog_data[1] = log_buf + log_buf_len;
-	syslog_data[2] = log_buf + log_end -
-		(logged_chars < log_buf_len ? logged_chars : log_buf_len);
-	syslog_data[3] = log_buf + log_end;
+	size_t len = dump_buf ? log_dump() : 0;
+
+	syslog_data[0] = dump_buf;
+	syslog_data[1] = dump_buf + dump_buf_len;
+	syslog_data[2] = dump_buf;
+	syslog_data[3] = dump_buf + len;
+}
+
+static int __init kdb_dump_buf_init(void)
+{
+	return dump_buf_alloc();
 }
+late_initcall(kdb_dump_buf_init);
 #endif	/* CONFIG_KGDB_KDB */
 
 /*
- * Call the console drivers on a range of log_buf
+ * Call the console drivers on a piece of text
  */
-static void __call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(const char *text, size_t len)
 {
 	struct console *con;
 
@@ -517,7 +946,7 @@ static void __call_console_drivers(unsigned start, unsigned end)
 		if ((con->flags & CON_ENABLED) && con->write &&
 				(cpu_online(smp_processor_id()) ||
 				(con->flags & CON_ANYTIME)))
-			con->write(con, &LOG_BUF(start), end - start);
+			con->write(con, text, len);
 	}
 }
 
@@ -536,25 +965,6 @@ module_param(ignore_loglevel, bool, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(ignore_loglevel, "ignore loglevel setting, to"
 	"print all kernel messages to the console.");
 
-/*
- * Write out chars from start to end - 1 inclusive
- */
-static void _call_console_drivers(unsigned start,
-				unsigned end, int msg_log_level)
-{
-	if ((msg_log_level < console_loglevel || ignore_loglevel) &&
-			console_drivers && start != end) {
-		if ((start & LOG_BUF_MASK) > (end & LOG_BUF_MASK)) {
-			/* wrapped write */
-			__call_console_drivers(start & LOG_BUF_MASK,
-						log_buf_len);
-			__call_console_drivers(0, end & LOG_BUF_MASK);
-		} else {
-			__call_console_drivers(start, end);
-		}
-	}
-}
-
 /*
  * Parse the syslog header <[0-9]*>. The decimal value represents 32bit, the
  * lower 3 bit are the log level, the rest are the log facility. In case
@@ -563,15 +973,16 @@ static void _call_console_drivers(unsigned start,
  * to extract the correct log level for in-kernel processing, and not mangle
  * the original value.
  *
- * If a prefix is found, the length of the prefix is returned. If 'level' is
- * passed, it will be filled in with the log level without a possible facility
- * value. If 'special' is passed, the special printk prefix chars are accepted
- * and returned. If no valid header is found, 0 is returned and the passed
- * variables are not touched.
+ * If a prefix is found, the length of the prefix is returned. If 'level' and
+ * 'facility' are passed, they will be filled in with the log level and the
+ * facility. If 'special' is passed, the special printk prefix chars are
+ * accepted and returned. If no valid header is found, 0 is returned and the
+ * passed variables are not touched.
  */
-static size_t log_prefix(const char *p, unsigned int *level, char *special)
+static size_t log_prefix(const char *p, unsigned int *level,
+			 unsigned int *facility, char *special)
 {
-	unsigned int lev = 0;
+	unsigned int lev = 0, fac = 0;
 	char sp = '\0';
 	size_t len;
 
@@ -594,10 +1005,12 @@ static size_t log_prefix(const char *p, unsigned int *level, char *special)
 	} else {
 		/* multi digit including the level and facility number */
 		char *endp = NULL;
+		unsigned long val = simple_strtoul(&p[1], &endp, 10);
 
-		lev = (simple_strtoul(&p[1], &endp, 10) & 7);
 		if (endp == NULL || endp[0] != '>')
 			return 0;
+		lev = val & 7;
+		fac = (val >> 3) & 0xff;
 		len = (endp + 1) - p;
 	}
 
@@ -614,94 +1027,78 @@ static size_t log_prefix(const char *p, unsigned int *level, char *special)
 
 	if (level)
 		*level = lev;
+	if (facility)
+		*facility = fac;
 	return len;
 }
 
 /*
- * Call the console drivers, asking them to write out
- * log_buf[start] to log_buf[end - 1].
+ * Call the console drivers on the messages from console_pos up to the
+ * first one that is not committed yet.
  * The console_lock must be held.
  */
-static void call_console_drivers(unsigned start, unsigned end)
+static void console_flush(void)
 {
-	unsigned cur_index, start_print;
-	static int msg_level = -1;
-
-	BUG_ON(((int)(start - end)) > 0);
+	static char text[LOG_LINE_MAX];
+	static char line[LOG_TEXT_MAX];
+	unsigned long flags;
+	struct log msg;
+	unsigned dropped;
+	bool lost = false;
+	size_t len;
 
-	cur_index = start;
-	start_print = start;
-	while (cur_index != end) {
-		if (msg_level < 0 && ((end - cur_index) > 2)) {
-			/* strip log prefix */
-			cur_index += log_prefix(&LOG_BUF(cur_index), &msg_level, NULL);
-			start_print = cur_index;
+	for (;;) {
+		if (unlikely(atomic_read(&log_dropped))) {
+			dropped = atomic_xchg(&log_dropped, 0);
+			len = scnprintf(line, sizeof(line),
+					"%s** %u printk messages dropped **\n",
+					console_newline ? "" : "\n", dropped);
+			call_console_drivers(line, len);
+			console_newline = true;
 		}
-		while (cur_index != end) {
-			char c = LOG_BUF(cur_index);
-
-			cur_index++;
-			if (c == '\n') {
-				if (msg_level < 0) {
-					/*
-					 * printk() has already given us loglevel tags in
-					 * the buffer.  This code is here in case the
-					 * log buffer has wrapped right round and scribbled
-					 * on those tags
-					 */
-					msg_level = default_message_loglevel;
-				}
-				_call_console_drivers(start_print, cur_index, msg_level);
-				msg_level = -1;
-				start_print = cur_index;
-				break;
-			}
+
+		if (!log_read(&console_pos, &msg, text, &lost))
+			break;
+
+		if (unlikely(lost)) {
+			len = scnprintf(line, sizeof(line),
+					"%s** console too slow, printk messages skipped **\n",
+					console_newline ? "" : "\n");
+			call_console_drivers(line, len);
+			console_newline = true;
+			lost = false;
 		}
+
+		if (!console_drivers ||
+		    (msg.level >= console_loglevel && !ignore_loglevel))
+			continue;
+
+		len = log_render(&msg, text, false, &console_newline,
+				 line, sizeof(line));
+		local_irq_save(flags);
+		stop_critical_timings();	/* don't trace print latency */
+		call_console_drivers(line, len);
+		start_critical_timings();
+		local_irq_restore(flags);
 	}
-	_call_console_drivers(start_print, end, msg_level);
 }
 
-static void emit_log_char(char c)
+/* Is there anything left for the consoles to print? */
+static bool console_pending(void)
 {
-	LOG_BUF(log_end) = c;
-	log_end++;
-	if (log_end - log_start > log_buf_len)
-		log_start = log_end - log_buf_len;
-	if (log_end - con_start > log_buf_len)
-		con_start = log_end - log_buf_len;
-	if (logged_chars < log_buf_len)
-		logged_chars++;
+	return log_pending(console_pos);
 }
 
 /*
- * Zap console related locks when oopsing. Only zap at most once
- * every 10 seconds, to leave time for slow consoles to print a
- * full oops.
+ * Print the log again from the oldest message syslog has not read yet.
+ * The console_lock must be held.
  */
-static void zap_locks(void)
+static void console_rewind(void)
 {
-	static unsigned long oops_timestamp;
-
-	if (time_after_eq(jiffies, oops_timestamp) &&
-			!time_after(jiffies, oops_timestamp + 30 * HZ))
-		return;
-
-	oops_timestamp = jiffies;
-
-	debug_locks_off();
-	/* If a crash is occurring, make sure we can't deadlock */
-	raw_spin_lock_init(&logbuf_lock);
-	/* And make sure that we print immediately */
-	sema_init(&console_sem, 1);
+	console_pos = syslog_pos;
+	console_newline = true;
 }
 
-#if defined(CONFIG_PRINTK_TIME)
-static bool printk_time = 1;
-#else
-static bool printk_time = 0;
-#endif
-module_param_named(time, printk_time, bool, S_IRUGO | S_IWUSR);
-
 static bool always_kmsg_dump;
 module_param_named(always_kmsg_dump, always_kmsg_dump, bool, S_IRUGO | S_IWUSR);
 
@@ -723,9 +1120,11 @@ static int have_callable_console(void)
  *
  * This is printk().  It can be called from any context.  We want it to work.
  *
- * We try to grab the console_lock.  If we succeed, it's easy - we log the output and
- * call the console drivers.  If we fail to get the semaphore we place the output
- * into the log buffer and return.  The current holder of the console_sem will
+ * The message is stored in the log buffer without taking any lock, and
+ * printk_thread is woken up to send it to the consoles.  Only while the
+ * system boots or goes down, or when it crashes, does printk() try to
+ * grab the console_lock and call the console drivers itself.  If it fails
+ * to get the semaphore, the current holder of the console_sem will
  * notice the new output in console_unlock(); and will send it to the
  * consoles before releasing the lock.
  *
@@ -759,9 +1158,6 @@ asmlinkage int printk(const char *fmt, ...)
 	return r;
 }
 
-/* cpu currently holding logbuf_lock */
-static volatile unsigned int printk_cpu = UINT_MAX;
-
 /*
  * Can we actually use the console at this time on this cpu?
  *
@@ -780,42 +1176,36 @@ static inline int can_use_console(unsigned int cpu)
  * messages from a 'printk'. Return true (and with the
  * console_lock held, and 'console_locked' set) if it
  * is successful, false otherwise.
- *
- * This gets called with the 'logbuf_lock' spinlock held and
- * interrupts disabled. It should return with 'lockbuf_lock'
- * released but interrupts still disabled.
  */
 static int console_trylock_for_printk(unsigned int cpu)
-	__releases(&logbuf_lock)
 {
-	int retval = 0, wake = 0;
-
-	if (console_trylock()) {
-		retval = 1;
+	if (!console_trylock())
+		return 0;
 
-		/*
-		 * If we can't use the console, we need to release
-		 * the console semaphore by hand to avoid flushing
-		 * the buffer. We need to hold the console semaphore
-		 * in order to do this test safely.
-		 */
-		if (!can_use_console(cpu)) {
-			console_locked = 0;
-			wake = 1;
-			retval = 0;
-		}
-	}
-	printk_cpu = UINT_MAX;
-	if (wake)
+	/*
+	 * If we can't use the console, we need to release
+	 * the console semaphore by hand to avoid flushing
+	 * the buffer. We need to hold the console semaphore
+	 * in order to do this test safely.
+	 */
+	if (!can_use_console(cpu)) {
+		console_locked = 0;
 		up(&console_sem);
-	raw_spin_unlock(&logbuf_lock);
-	return retval;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Does printk() have to print to the consoles itself rather than leave
+ * it to printk_thread?  It does before that thread is started, while the
+ * system boots or goes down, and when it is crashing.
+ */
+static inline bool printk_sync(void)
+{
+	return !printk_thread || oops_in_progress ||
+		system_state != SYSTEM_RUNNING;
 }
-static const char recursion_bug_msg [] =
-		KERN_CRIT "BUG: recent printk recursion!\n";
-static int recursion_bug;
-static int new_text_line = 1;
-static char printk_buf[1024];
 
 int printk_delay_msec __read_mostly;
 
@@ -833,140 +1223,98 @@ static inline void printk_delay(void)
 
 asmlinkage int vprintk(const char *fmt, va_list args)
 {
-	int printed_len = 0;
-	int current_log_level = default_message_loglevel;
-	unsigned long flags;
-	int this_cpu;
-	char *p;
-	size_t plen;
-	char special;
+	unsigned int level = default_message_loglevel, facility = 0;
+	int printed_len, log_flags = 0;
+	unsigned long flags, pos;
+	size_t plen, text_len;
+	struct log *msg;
+	char special = '\0';
+	char *text;
+	va_list args2;
 
 	boot_delay_msec();
 	printk_delay();
 
-	/* This stops the holder of console_sem just where we want him */
-	local_irq_save(flags);
-	this_cpu = smp_processor_id();
+	/* Size the record first, the message is formatted right into it */
+	va_copy(args2, args);
+	text_len = vsnprintf(NULL, 0, fmt, args2);
+	va_end(args2);
+	text_len = min_t(size_t, text_len, LOG_LINE_MAX - 1);
 
 	/*
-	 * Ouch, printk recursed into itself!
+	 * Interrupts stay off while the record is being written: readers,
+	 * and writers needing its room once it is the oldest one, wait for
+	 * it to be committed.
 	 */
-	if (unlikely(printk_cpu == this_cpu)) {
-		/*
-		 * If a crash is occurring during printk() on this CPU,
-		 * then try to get the crash message out but make sure
-		 * we can't deadlock. Otherwise just return to avoid the
-		 * recursion and return - but flag the recursion so that
-		 * it can be printed at the next appropriate moment:
-		 */
-		if (!oops_in_progress && !lockdep_recursing(current)) {
-			recursion_bug = 1;
-			goto out_restore_irqs;
-		}
-		zap_locks();
-	}
-
-	lockdep_off();
-	raw_spin_lock(&logbuf_lock);
-	printk_cpu = this_cpu;
-
-	if (recursion_bug) {
-		recursion_bug = 0;
-		strcpy(printk_buf, recursion_bug_msg);
-		printed_len = strlen(recursion_bug_msg);
+	local_irq_save(flags);
+	msg = log_reserve(text_len + 1, &pos);
+	if (unlikely(!msg)) {
+		atomic_inc(&log_dropped);
+		local_irq_restore(flags);
+		return 0;
 	}
-	/* Emit the output into the temporary buffer */
-	printed_len += vscnprintf(printk_buf + printed_len,
-				  sizeof(printk_buf) - printed_len, fmt, args);
-
-	p = printk_buf;
+	text = (char *)(msg + 1);
+	printed_len = vscnprintf(text, text_len + 1, fmt, args);
+	text_len = printed_len;
 
 	/* Read log level and handle special printk prefix */
-	plen = log_prefix(p, &current_log_level, &special);
+	plen = log_prefix(text, &level, &facility, &special);
 	if (plen) {
-		p += plen;
-
-		switch (special) {
-		case 'c': /* Strip <c> KERN_CONT, continue line */
-			plen = 0;
-			break;
-		case 'd': /* Strip <d> KERN_DEFAULT, start new line */
-			plen = 0;
-		default:
-			if (!new_text_line) {
-				emit_log_char('\n');
-				new_text_line = 1;
-			}
-		}
+		text_len -= plen;
+		memmove(text, text + plen, text_len);
+	}
+	if (text_len && text[text_len - 1] == '\n') {
+		text_len--;
+		log_flags |= LOG_NEWLINE;
 	}
 
 	/*
-	 * Copy the output into log_buf. If the caller didn't provide
-	 * the appropriate log prefix, we insert them here
+	 * A message with KERN_CONT, or without any prefix, continues the
+	 * line of the previous message if that did not end it.
 	 */
-	for (; *p; p++) {
-		if (new_text_line) {
-			new_text_line = 0;
-
-			if (plen) {
-				/* Copy original log prefix */
-				int i;
-
-				for (i = 0; i < plen; i++)
-					emit_log_char(printk_buf[i]);
-				printed_len += plen;
-			} else {
-				/* Add log prefix */
-				emit_log_char('<');
-				emit_log_char(current_log_level + '0');
-				emit_log_char('>');
-				printed_len += 3;
-			}
-
-			if (printk_time) {
-				/* Add the current time stamp */
-				char tbuf[50], *tp;
-				unsigned tlen;
-				unsigned long long t;
-				unsigned long nanosec_rem;
-
-				t = cpu_clock(printk_cpu);
-				nanosec_rem = do_div(t, 1000000000);
-				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
-						(unsigned long) t,
-						nanosec_rem / 1000);
-
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
-			}
-
-			if (!*p)
-				break;
-		}
+	if ((special == 'c' || !plen) && !log_prev_newline) {
+		log_flags |= LOG_CONT;
+		level = log_prev_level;
+	}
 
-		emit_log_char(*p);
-		if (*p == '\n')
-			new_text_line = 1;
+	if (text_len || (log_flags & LOG_NEWLINE)) {
+		log_prev_newline = log_flags & LOG_NEWLINE;
+		log_prev_level = level;
+	} else {
+		/* nothing to print, but a prefix still ends the line */
+		if (!(log_flags & LOG_CONT))
+			log_prev_newline = true;
+		log_flags = LOG_PAD;
 	}
 
-	/*
-	 * Try to acquire and then immediately release the
-	 * console semaphore. The release will do all the
-	 * actual magic (print out buffers, wake up klogd,
-	 * etc). 
-	 *
-	 * The console_trylock_for_printk() function
-	 * will release 'logbuf_lock' regardless of whether it
-	 * actually gets the semaphore or not.
-	 */
-	if (console_trylock_for_printk(this_cpu))
-		console_unlock();
+	msg->ts_nsec = local_clock();
+	msg->text_len = text_len;
+	msg->facility = facility;
+	msg->flags = log_flags;
+	msg->level = level;
+	log_commit(msg, pos);
 
-	lockdep_on();
-out_restore_irqs:
-	local_irq_restore(flags);
+	if (printk_sync()) {
+		/*
+		 * Try to acquire and then immediately release the
+		 * console semaphore. The release will do all the
+		 * actual magic (print out buffers, etc).
+		 */
+		lockdep_off();
+		if (console_trylock_for_printk(smp_processor_id()))
+			console_unlock();
+		lockdep_on();
+		local_irq_restore(flags);
+	} else if (in_nmi() || irqs_disabled_flags(flags)) {
+		/* We may hold the runqueue lock, leave it to printk_tick() */
+		this_cpu_or(printk_pending, PRINTK_PENDING_CONSOLE);
+		local_irq_restore(flags);
+	} else {
+		local_irq_restore(flags);
+		wake_up_process(printk_thread);
+	}
 
+	wake_up_klogd();
 	return printed_len;
 }
 EXPORT_SYMBOL(printk);
@@ -974,7 +1322,16 @@ EXPORT_SYMBOL(vprintk);
 
 #else
 
-static void call_console_drivers(unsigned start, unsigned end)
+static void console_flush(void)
+{
+}
+
+static bool console_pending(void)
+{
+	return false;
+}
+
+static void console_rewind(void)
 {
 }
 
@@ -1126,6 +1483,7 @@ void suspend_console(void)
 		return;
 	printk("Suspending console(s) (use no_console_suspend to debug)\n");
 	console_lock();
+	console_flush();
 	console_suspended = 1;
 	up(&console_sem);
 }
@@ -1211,13 +1569,15 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-static DEFINE_PER_CPU(int, printk_pending);
-
 void printk_tick(void)
 {
 	if (__this_cpu_read(printk_pending)) {
-		__this_cpu_write(printk_pending, 0);
-		wake_up_interruptible(&log_wait);
+		int pending = __this_cpu_xchg(printk_pending, 0);
+
+		if (pending & PRINTK_PENDING_CONSOLE)
+			wake_up_process(printk_thread);
+		if (pending & PRINTK_PENDING_WAKEUP)
+			wake_up_interruptible(&log_wait);
 	}
 }
 
@@ -1231,7 +1591,7 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		this_cpu_write(printk_pending, 1);
+		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
 }
 
 /**
@@ -1244,16 +1604,10 @@ void wake_up_klogd(void)
  * by printk().  If this is the case, console_unlock(); emits
  * the output prior to releasing the lock.
  *
- * If there is output waiting for klogd, we wake it up.
- *
  * console_unlock(); may be called from any context.
  */
 void console_unlock(void)
 {
-	unsigned long flags;
-	unsigned _con_start, _log_end;
-	unsigned wake_klogd = 0, retry = 0;
-
 	if (console_suspended) {
 		up(&console_sem);
 		return;
@@ -1262,28 +1616,13 @@ void console_unlock(void)
 	console_may_schedule = 0;
 
 again:
-	for ( ; ; ) {
-		raw_spin_lock_irqsave(&logbuf_lock, flags);
-		wake_klogd |= log_start - log_end;
-		if (con_start == log_end)
-			break;			/* Nothing to print */
-		_con_start = con_start;
-		_log_end = log_end;
-		con_start = log_end;		/* Flush */
-		raw_spin_unlock(&logbuf_lock);
-		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(_con_start, _log_end);
-		start_critical_timings();
-		local_irq_restore(flags);
-	}
+	console_flush();
 	console_locked = 0;
 
 	/* Release the exclusive_console once it is used */
 	if (unlikely(exclusive_console))
 		exclusive_console = NULL;
 
-	raw_spin_unlock(&logbuf_lock);
-
 	up(&console_sem);
 
 	/*
@@ -1292,16 +1631,8 @@ again:
 	 * there's a new owner and the console_unlock() from them will do the
 	 * flush, no worries.
 	 */
-	raw_spin_lock(&logbuf_lock);
-	if (con_start != log_end)
-		retry = 1;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
-
-	if (retry && console_trylock())
+	if (console_pending() && console_trylock())
 		goto again;
-
-	if (wake_klogd)
-		wake_up_klogd();
 }
 EXPORT_SYMBOL(console_unlock);
 
@@ -1418,7 +1749,6 @@ early_param("keep_bootcon", keep_bootcon_setup);
 void register_console(struct console *newcon)
 {
 	int i;
-	unsigned long flags;
 	struct console *bcon = NULL;
 
 	/*
@@ -1529,9 +1859,7 @@ void register_console(struct console *newcon)
 		 * console_unlock(); will print out the buffered messages
 		 * for us.
 		 */
-		raw_spin_lock_irqsave(&logbuf_lock, flags);
-		con_start = log_start;
-		raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+		console_rewind();
 		/*
 		 * We're about to replay the log buffer.  Only do this to the
 		 * just-registered console to avoid excessive message spam to
@@ -1606,9 +1934,29 @@ int unregister_console(struct console *console)
 }
 EXPORT_SYMBOL(unregister_console);
 
+#ifdef CONFIG_PRINTK
+static int printk_kthread(void *unused)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (console_suspended || !console_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+		cond_resched();
+	}
+	return 0;
+}
+#endif
+
 static int __init printk_late_init(void)
 {
 	struct console *con;
+#ifdef CONFIG_PRINTK
+	struct task_struct *t;
+#endif
 
 	for_each_console(con) {
 		if (!keep_bootcon && con->flags & CON_BOOT) {
@@ -1618,6 +1966,11 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+#ifdef CONFIG_PRINTK
+	t = kthread_run(printk_kthread, NULL, "printk");
+	if (!IS_ERR(t))
+		printk_thread = t;
+#endif
 	return 0;
 }
 late_initcall(printk_late_init);
@@ -1670,7 +2023,7 @@ static LIST_HEAD(dump_list);
  *
  * Adds a kernel log dumper to the system. The dump callback in the
  * structure will be called when the kernel oopses or panics and must be
- * set. Returns zero on success and %-EINVAL or %-EBUSY otherwise.
+ * set. Returns zero on success and %-EINVAL, %-ENOMEM or %-EBUSY otherwise.
  */
 int kmsg_dump_register(struct kmsg_dumper *dumper)
 {
@@ -1681,6 +2034,9 @@ int kmsg_dump_register(struct kmsg_dumper *dumper)
 	if (!dumper->dump)
 		return -EINVAL;
 
+	if (dump_buf_alloc())
+		return -ENOMEM;
+
 	spin_lock_irqsave(&dump_list_lock, flags);
 	/* Don't allow registering multiple times */
 	if (!dumper->registered) {
@@ -1724,45 +2080,34 @@ EXPORT_SYMBOL_GPL(kmsg_dump_unregister);
  * @reason: the reason (oops, panic etc) for dumping
  *
  * Iterate through each of the dump devices and call the oops/panic
- * callbacks with the log buffer.
+ * callbacks with the log buffer, rendered as syslog text.
  */
 void kmsg_dump(enum kmsg_dump_reason reason)
 {
-	unsigned long end;
-	unsigned chars;
 	struct kmsg_dumper *dumper;
-	const char *s1, *s2;
-	unsigned long l1, l2;
-	unsigned long flags;
+	size_t len;
 
 	if ((reason > KMSG_DUMP_OOPS) && !always_kmsg_dump)
 		return;
 
-	/* Theoretically, the log could move on after we do this, but
-	   there's not a lot we can do about that. The new messages
-	   will overwrite the start of what we dump. */
-	raw_spin_lock_irqsave(&logbuf_lock, flags);
-	end = log_end & LOG_BUF_MASK;
-	chars = logged_chars;
-	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
-
-	if (chars > end) {
-		s1 = log_buf + log_buf_len - chars + end;
-		l1 = chars - end;
+	/* No dumper was ever registered */
+	if (!dump_buf)
+		return;
 
-		s2 = log_buf;
-		l2 = end;
-	} else {
-		s1 = "";
-		l1 = 0;
+	/*
+	 * Only one CPU at a time can render the log into dump_buf, the
+	 * dumpers would not cope with several dumps at once either.
+	 */
+	if (test_and_set_bit(0, &dump_busy))
+		return;
 
-		s2 = log_buf + end - chars;
-		l2 = chars;
-	}
+	len = log_dump();
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(dumper, &dump_list, list)
-		dumper->dump(dumper, reason, s1, l1, s2, l2);
+		dumper->dump(dumper, reason, "", 0, dump_buf, len);
 	rcu_read_unlock();
+
+	clear_bit_unlock(0, &dump_busy);
 }
 #endif
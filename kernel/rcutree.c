@@ -1700,9 +1700,13 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Queue a callback.  Unless @offload is false, the callbacks of a
+ * no-CBs CPU go to its rcuo kthread instead of its own lists.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, bool offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1722,6 +1726,11 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	if (offload && __call_rcu_nocb(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1778,7 +1787,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1787,7 +1796,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1935,6 +1944,21 @@ static int rcu_cpu_has_callbacks(int cpu)
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Check whether a full dynticks CPU running a task must keep its
+ * scheduling-clock tick for RCU: to report a quiescent state some grace
+ * period is waiting for, or to advance callbacks queued on it.  Unlike
+ * rcu_needs_cpu(), this is not about an idle CPU.  A CPU which stopped
+ * its tick and is later needed by a new grace period is caught by the
+ * reschedule IPI of force_quiescent_state(), which restarts the tick.
+ */
+int rcu_nohz_full_needs_tick(int cpu)
+{
+	return rcu_pending(cpu) || rcu_cpu_has_callbacks(cpu);
+}
+#endif
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
@@ -1969,6 +1993,9 @@ static void _rcu_barrier(struct rcu_state *rsp,
 			 void (*call_rcu_func)(struct rcu_head *head,
 					       void (*func)(struct rcu_head *head)))
 {
+	struct rcu_head *head;
+	int cpu;
+
 	BUG_ON(in_interrupt());
 	/* Take mutex to serialize concurrent rcu_barrier() requests. */
 	mutex_lock(&rcu_barrier_mutex);
@@ -1984,8 +2011,27 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	 * any CPUs from coming online or going offline until each online
 	 * CPU has queued its RCU-barrier callback.
 	 */
+	get_online_cpus();
 	atomic_set(&rcu_barrier_cpu_count, 1);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+
+	/*
+	 * An offline no-CBs CPU is not reached above, but its rcuo kthread
+	 * may still hold callbacks: queue a barrier callback behind them.
+	 * Online no-CBs CPUs already queued theirs through the same path.
+	 */
+	for_each_possible_cpu(cpu) {
+		if (cpu_online(cpu) || !is_nocb_cpu(cpu))
+			continue;
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		__call_rcu_nocb_enqueue(per_cpu_ptr(rsp->rda, cpu), head);
+	}
+	put_online_cpus();
+
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
 	wait_for_completion(&rcu_barrier_completion);
@@ -2033,6 +2079,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -26,6 +26,7 @@
 #include <linux/slab.h>
 #include <linux/profile.h>
 #include <linux/interrupt.h>
+#include <linux/mempolicy.h>
 
 #include <trace/events/sched.h>
 
@@ -776,6 +777,284 @@ update_stats_curr_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
  * Scheduling class queueing methods:
  */
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing.
+ *
+ * Every scan period of task runtime, a chunk of the address space is
+ * turned into NUMA hinting ptes by task_numa_work().  The hinting faults
+ * migrate misplaced pages towards the accessing node and are counted per
+ * node by task_numa_fault().  Once per pass over the address space the
+ * counts decide the task's preferred node, which it is then moved to and
+ * which the load balancer is reluctant to move it away from.
+ */
+unsigned int sysctl_numa_balancing = 1;
+
+/* Delay before the first scan of a new address space, in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* Bounds of the period between scans, in ms of task runtime */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* Amount of address space scanned per period, in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+/*
+ * Move current to the least loaded CPU of its preferred node, unless
+ * that CPU is at least as busy as the one it runs on now.
+ */
+static void task_numa_migrate_preferred(struct task_struct *p)
+{
+	int nid = p->numa_preferred_nid;
+	unsigned long nr, min_nr = ULONG_MAX;
+	int cpu, best_cpu = -1;
+
+	if (nid == -1 || cpu_to_node(task_cpu(p)) == nid)
+		return;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nid), tsk_cpus_allowed(p)) {
+		if (!cpu_active(cpu))
+			continue;
+		nr = ACCESS_ONCE(cpu_rq(cpu)->nr_running);
+		if (nr < min_nr) {
+			min_nr = nr;
+			best_cpu = cpu;
+		}
+	}
+
+	if (best_cpu == -1 ||
+	    min_nr >= ACCESS_ONCE(cpu_rq(task_cpu(p))->nr_running))
+		return;
+
+	migrate_task_to(p, best_cpu);
+}
+
+static void task_numa_placement(struct task_struct *p)
+{
+	unsigned long faults, max_faults = 0;
+	int seq, nid, max_nid = -1;
+
+	seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	/* Decay the faults of past passes and add those of the last one */
+	for_each_online_node(nid) {
+		faults = p->numa_faults[nid] / 2 + p->numa_faults_buffer[nid];
+		p->numa_faults[nid] = faults;
+		p->numa_faults_buffer[nid] = 0;
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+	}
+
+	if (max_nid != -1)
+		p->numa_preferred_nid = max_nid;
+
+	task_numa_migrate_preferred(p);
+}
+
+/*
+ * Account a NUMA hinting fault of current on @pages pages, now on @node.
+ */
+void task_numa_fault(int node, int pages, bool migrated)
+{
+	struct task_struct *p = current;
+
+	if (!sysctl_numa_balancing)
+		return;
+
+	/* ksmd, or a kthread borrowing an mm with use_mm(), is not placed */
+	if (!p->mm || (p->flags & PF_KTHREAD))
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		int size = sizeof(*p->numa_faults) * 2 * nr_node_ids;
+
+		p->numa_faults = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+		p->numa_faults_buffer = p->numa_faults + nr_node_ids;
+	}
+
+	/*
+	 * Scan faster while the faults still find pages to move, and back
+	 * off slowly once the memory has settled where the task runs.
+	 */
+	if (migrated) {
+		p->numa_pages_migrated += pages;
+		p->numa_scan_period = max(sysctl_numa_balancing_scan_period_min,
+					  p->numa_scan_period / 2);
+	} else {
+		p->numa_scan_period = min(sysctl_numa_balancing_scan_period_max,
+					  p->numa_scan_period +
+					  jiffies_to_msecs(10));
+	}
+
+	task_numa_placement(p);
+
+	p->numa_faults_buffer[node] += pages;
+}
+
+static void reset_ptenuma_scan(struct mm_struct *mm)
+{
+	ACCESS_ONCE(mm->numa_scan_seq)++;
+	mm->numa_scan_offset = 0;
+}
+
+/*
+ * Turn the next chunk of current's address space into NUMA hinting
+ * ptes.  Run on the way back to user space, once task_tick_numa()
+ * found a scan due.
+ */
+void task_numa_work(void)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages;
+
+	if (!p->numa_work_pending)
+		return;
+	p->numa_work_pending = 0;
+
+	if (!mm || (p->flags & PF_EXITING))
+		return;
+
+	/* Let a new address space settle before the first scan */
+	if (!mm->numa_next_scan)
+		mm->numa_next_scan = now +
+			msecs_to_jiffies(sysctl_numa_balancing_scan_delay);
+
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	/* Only one of the threads sharing the mm scans each period */
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT;
+	start = mm->numa_scan_offset;
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, start);
+	if (!vma) {
+		reset_ptenuma_scan(mm);
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_migratable(vma) ||
+		    !(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = ALIGN(start + (pages << PAGE_SHIFT), PMD_SIZE);
+			end = min(end, vma->vm_end);
+			change_prot_numa(vma, start, end);
+			/* Charge the range, populated or not: bounded work */
+			pages -= (end - start) >> PAGE_SHIFT;
+
+			start = end;
+			if (pages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+
+out:
+	/* Resume where we stopped next time, or start a new pass */
+	if (vma)
+		mm->numa_scan_offset = start;
+	else
+		reset_ptenuma_scan(mm);
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Called from the tick: once current has run for its scan period, have it
+ * scan the next chunk of its address space on return to user space.
+ */
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	u64 period, now;
+
+	if (!sysctl_numa_balancing || nr_online_nodes <= 1)
+		return;
+
+	if (!curr->mm || (curr->flags & (PF_EXITING | PF_KTHREAD)) ||
+	    curr->numa_work_pending)
+		return;
+
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		curr->node_stamp = now;
+
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			curr->numa_work_pending = 1;
+			set_tsk_thread_flag(curr, TIF_NOTIFY_RESUME);
+		}
+	}
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+/*
+ * Would moving @p from @src_cpu to @dst_cpu take it to, or away from,
+ * the node holding most of its memory?
+ */
+static bool migrate_improves_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int src_nid = cpu_to_node(src_cpu), dst_nid = cpu_to_node(dst_cpu);
+
+	if (!sysctl_numa_balancing || src_nid == dst_nid)
+		return false;
+
+	return dst_nid == p->numa_preferred_nid;
+}
+
+static bool migrate_degrades_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int src_nid = cpu_to_node(src_cpu), dst_nid = cpu_to_node(dst_cpu);
+
+	if (!sysctl_numa_balancing || src_nid == dst_nid)
+		return false;
+
+	return src_nid == p->numa_preferred_nid;
+}
+#else
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+
+static inline bool migrate_improves_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+
+static inline bool migrate_degrades_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #if defined CONFIG_SMP && defined CONFIG_FAIR_GROUP_SCHED
 static void
 add_cfs_task_weight(struct cfs_rq *cfs_rq, unsigned long weight)
@@ -3165,11 +3444,17 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 
 	/*
 	 * Aggressive migration if:
-	 * 1) task is cache cold, or
-	 * 2) too many balance attempts have failed.
+	 * 1) task is moving to the node holding most of its memory, or
+	 * 2) task is cache cold, or
+	 * 3) too many balance attempts have failed.
+	 *
+	 * Moving a task away from its memory counts as cache hot.
 	 */
+	if (migrate_improves_locality(p, cpu_of(rq), this_cpu))
+		return 1;
 
-	tsk_cache_hot = task_hot(p, rq->clock_task, sd);
+	tsk_cache_hot = task_hot(p, rq->clock_task, sd) ||
+			migrate_degrades_locality(p, cpu_of(rq), this_cpu);
 	if (!tsk_cache_hot ||
 		sd->nr_balance_failed > sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -5208,6 +5493,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
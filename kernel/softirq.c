@@ -351,6 +351,8 @@ void irq_exit(void)
 	/* Make sure that timer wheel updates are propagated */
 	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
 		tick_nohz_irq_exit();
+	else if (tick_nohz_full_cpu(smp_processor_id()) && !in_interrupt())
+		tick_nohz_full_irq_exit();
 #endif
 	rcu_irq_exit();
 	preempt_enable_no_resched();
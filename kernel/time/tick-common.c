@@ -296,6 +296,10 @@ static void tick_handover_do_timer(int *cpup)
 	if (*cpup == tick_do_timer_cpu) {
 		int cpu = cpumask_first(cpu_online_mask);
 
+#ifdef CONFIG_NO_HZ_FULL
+		if (tick_nohz_full_running)
+			cpu = tick_nohz_housekeeping_cpu();
+#endif
 		tick_do_timer_cpu = (cpu < nr_cpu_ids) ? cpu :
 			TICK_DO_TIMER_NONE;
 	}
@@ -20,6 +20,10 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/irq_work.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
+#include <linux/bootmem.h>
 
 #include <asm/irq_regs.h>
 
@@ -123,6 +127,70 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+bool tick_nohz_full_running;
+cpumask_var_t tick_nohz_full_mask;
+
+/*
+ * Parse the nohz_full= boot parameter. The boot CPU keeps the timekeeping
+ * duty and is never a full dynticks CPU.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static int __init tick_nohz_full_init(void)
+{
+	char buf[64];
+
+	if (!tick_nohz_full_running)
+		return 0;
+
+	if (!tick_nohz_enabled) {
+		printk(KERN_WARNING "NOHZ: nohz=off, ignoring nohz_full\n");
+		tick_nohz_full_running = false;
+		return 0;
+	}
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", buf);
+	return 0;
+}
+core_initcall(tick_nohz_full_init);
+
+/*
+ * Return an online CPU which is not a full dynticks CPU, for the work
+ * these hand off: unpinned timers, timekeeping.
+ */
+int tick_nohz_housekeeping_cpu(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		if (!cpumask_test_cpu(cpu, tick_nohz_full_mask))
+			return cpu;
+	}
+	return cpumask_first(cpu_online_mask);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -275,49 +343,14 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
-static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
+static void tick_nohz_stop_sched_tick(struct tick_sched *ts, ktime_t now,
+				      int cpu)
 {
 	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
-	ktime_t last_update, expires, now;
+	ktime_t last_update, expires;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
 	u64 time_delta;
-	int cpu;
-
-	cpu = smp_processor_id();
-	ts = &per_cpu(tick_cpu_sched, cpu);
-
-	now = tick_nohz_start_idle(cpu, ts);
-
-	/*
-	 * If this cpu is offline and it is the one which updates
-	 * jiffies, then give up the assignment and let it be taken by
-	 * the cpu which runs the tick timer next. If we don't drop
-	 * this here the jiffies might be stale and do_timer() never
-	 * invoked.
-	 */
-	if (unlikely(!cpu_online(cpu))) {
-		if (cpu == tick_do_timer_cpu)
-			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
-	}
-
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
-		return;
 
-	if (need_resched())
-		return;
-
-	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
-		static int ratelimit;
-
-		if (ratelimit < 10) {
-			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
-			       (unsigned int) local_softirq_pending());
-			ratelimit++;
-		}
-		return;
-	}
-
-	ts->idle_calls++;
 	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&xtime_lock);
@@ -387,6 +420,14 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 					   tick_period.tv64 * delta_jiffies);
 		}
 
+		/*
+		 * A busy full dynticks CPU still takes a residual tick
+		 * once per second, which keeps the scheduler statistics
+		 * and the load accounting of the running task alive.
+		 */
+		if (!ts->inidle)
+			time_delta = min_t(u64, time_delta, NSEC_PER_SEC);
+
 		if (time_delta < KTIME_MAX)
 			expires = ktime_add_ns(last_update, time_delta);
 		else
@@ -404,8 +445,6 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-
 			ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
 			ts->idle_jiffies = last_jiffies;
@@ -448,6 +487,69 @@ out:
 	ts->sleep_length = ktime_sub(dev->next_event, now);
 }
 
+static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
+{
+	/*
+	 * If this cpu is offline and it is the one which updates
+	 * jiffies, then give up the assignment and let it be taken by
+	 * the cpu which runs the tick timer next. If we don't drop
+	 * this here the jiffies might be stale and do_timer() never
+	 * invoked.
+	 */
+	if (unlikely(!cpu_online(cpu))) {
+		if (cpu == tick_do_timer_cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	}
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return false;
+
+	if (need_resched())
+		return false;
+
+	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
+		static int ratelimit;
+
+		if (ratelimit < 10) {
+			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
+			       (unsigned int) local_softirq_pending());
+			ratelimit++;
+		}
+		return false;
+	}
+
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * Full dynticks CPUs never take the do_timer() duty, so the
+	 * housekeeping CPU which has it must keep its tick even in
+	 * idle, or jiffies would stall under the busy full CPUs.
+	 */
+	if (tick_nohz_full_running) {
+		if (tick_do_timer_cpu == cpu ||
+		    tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+#endif
+
+	return true;
+}
+
+static void __tick_nohz_idle_enter(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	ktime_t now;
+
+	now = tick_nohz_start_idle(cpu, ts);
+
+	if (!can_stop_idle_tick(cpu, ts))
+		return;
+
+	ts->idle_calls++;
+	tick_nohz_stop_sched_tick(ts, now, cpu);
+	if (ts->tick_stopped)
+		select_nohz_load_balancer(1);
+}
+
 /**
  * tick_nohz_idle_enter - stop the idle tick from the idle task
  *
@@ -483,7 +585,7 @@ void tick_nohz_idle_enter(void)
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 
 	local_irq_enable();
 }
@@ -503,7 +605,7 @@ void tick_nohz_irq_exit(void)
 	if (!ts->inidle)
 		return;
 
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 }
 
 /**
@@ -544,6 +646,172 @@ static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
 	}
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * update_process_times() charges the current task one jiffy per tick.
+ * Charge the jiffies skipped while the tick was stopped on a busy full
+ * dynticks CPU to the task which ran across them.
+ */
+static void tick_nohz_account_ticks(struct tick_sched *ts,
+				    struct task_struct *p)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->idle_jiffies;
+
+	if (ticks && ticks < LONG_MAX) {
+		cputime_t cputime = jiffies_to_cputime(ticks);
+
+		account_user_time(p, cputime, cputime_to_scaled(cputime));
+	}
+#endif
+	ts->idle_jiffies = jiffies;
+}
+
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+#ifdef CONFIG_HAVE_UNSTABLE_SCHED_CLOCK
+	/* sched_clock_tick() keeps an unstable sched_clock in sync */
+	if (!sched_clock_stable)
+		return false;
+#endif
+
+	if (rcu_nohz_full_needs_tick(cpu))
+		return false;
+
+	return true;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ktime_t now = ktime_get();
+
+	tick_do_update_jiffies64(now);
+	tick_nohz_account_ticks(ts, current);
+	touch_softlockup_watchdog();
+
+	ts->tick_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/**
+ * tick_nohz_full_irq_exit - stop or restart the tick of a busy full CPU
+ *
+ * Called from irq_exit() on a full dynticks CPU which is not idle. The
+ * interrupt may have enqueued a second task, armed a timer or started
+ * a grace period, so decide again whether the tick is needed.
+ */
+void tick_nohz_full_irq_exit(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	int cpu = smp_processor_id();
+
+	if (ts->inidle || is_idle_task(current))
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (!can_stop_full_tick(cpu)) {
+		if (ts->tick_stopped)
+			tick_nohz_full_restart(ts);
+		return;
+	}
+
+	if (need_resched() || local_softirq_pending())
+		return;
+
+	tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+}
+
+/*
+ * Nothing to do here: the point is the interrupt, whose irq_exit()
+ * re-evaluates the tick of the full dynticks CPU.
+ */
+static void nohz_full_kick_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_func,
+};
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks CPU re-evaluate its tick
+ * @cpu: the CPU to kick
+ *
+ * Used when something that needs the tick, a second runnable task or a
+ * timer, is added to @cpu. May be called with interrupts disabled.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu == smp_processor_id())
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+	else
+		smp_send_reschedule(cpu);
+}
+
+static void nohz_full_kick_ipi(void *info)
+{
+}
+
+/*
+ * Kick all full dynticks CPUs, for state which is not bound to one CPU,
+ * like a process wide CPU timer. Must be called with interrupts enabled.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	smp_call_function_many(tick_nohz_full_mask,
+			       nohz_full_kick_ipi, NULL, false);
+	preempt_enable();
+}
+
+/**
+ * tick_nohz_task_switch - account a stopped tick over a context switch
+ * @prev: the task which ran until now
+ *
+ * On a full dynticks CPU whose tick is stopped, charge the skipped
+ * jiffies to @prev, and let irq_exit() decide again for the next task.
+ */
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	if (!tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->tick_stopped && !ts->inidle) {
+		tick_nohz_account_ticks(ts, prev);
+		if (!is_idle_task(current))
+			tick_nohz_full_kick_cpu(smp_processor_id());
+	}
+	local_irq_restore(flags);
+}
+#else
+static inline void tick_nohz_account_ticks(struct tick_sched *ts,
+					   struct task_struct *p) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_idle_exit - restart the idle tick from the idle task
  *
@@ -631,7 +899,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -649,6 +918,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
+		if (!ts->inidle)
+			tick_nohz_account_ticks(ts, current);
 	}
 
 	update_process_times(user_mode(regs));
@@ -783,7 +1054,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -807,6 +1079,10 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		if (ts->tick_stopped) {
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
+#ifdef CONFIG_NO_HZ
+			if (!ts->inidle)
+				tick_nohz_account_ticks(ts, current);
+#endif
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
@@ -95,16 +95,21 @@ static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 	return root->gfp_mask & __GFP_BITS_MASK;
 }
 
+/*
+ * Node tags are modified with atomic bitops because
+ * radix_tree_tag_set_lockless() may set bits in the same words without
+ * holding the tree lock.
+ */
 static inline void tag_set(struct radix_tree_node *node, unsigned int tag,
 		int offset)
 {
-	__set_bit(offset, node->tags[tag]);
+	set_bit(offset, node->tags[tag]);
 }
 
 static inline void tag_clear(struct radix_tree_node *node, unsigned int tag,
 		int offset)
 {
-	__clear_bit(offset, node->tags[tag]);
+	clear_bit(offset, node->tags[tag]);
 }
 
 static inline int tag_get(struct radix_tree_node *node, unsigned int tag,
@@ -509,6 +514,7 @@ EXPORT_SYMBOL(radix_tree_tag_set);
 void *radix_tree_tag_clear(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag)
 {
+	struct radix_tree_node *child = NULL;
 	struct radix_tree_node *node = NULL;
 	struct radix_tree_node *slot = NULL;
 	unsigned int height, shift;
@@ -538,23 +544,119 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		if (!tag_get(node, tag, offset))
 			goto out;
 		tag_clear(node, tag, offset);
+		/*
+		 * A lockless setter sets the child's bit before looking at
+		 * ours: if it did so after we found the child untagged, the
+		 * recheck sees it, otherwise the setter sees our bit clear
+		 * and sets it again itself.
+		 */
+		if (child) {
+			smp_mb();
+			if (any_tag_set(child, tag)) {
+				tag_set(node, tag, offset);
+				goto out;
+			}
+		}
 		if (any_tag_set(node, tag))
 			goto out;
 
 		index >>= RADIX_TREE_MAP_SHIFT;
 		offset = index & RADIX_TREE_MAP_MASK;
+		child = node;
 		node = node->parent;
 	}
 
 	/* clear the root's tag bit */
-	if (root_tag_get(root, tag))
+	if (root_tag_get(root, tag)) {
 		root_tag_clear(root, tag);
+		smp_mb();
+		if (child && any_tag_set(child, tag))
+			root_tag_set(root, tag);
+	}
 
 out:
 	return slot;
 }
 EXPORT_SYMBOL(radix_tree_tag_clear);
 
+/**
+ *	radix_tree_tag_set_lockless - set a tag without the tree lock
+ *	@root:		radix tree root
+ *	@index:		index key
+ *	@tag: 		tag index
+ *
+ *	Like radix_tree_tag_set(), but may be called under rcu_read_lock()
+ *	instead of the lock serialising modifications of the tree.  The caller
+ *	must guarantee that the item at @index is neither deleted nor replaced
+ *	meanwhile, and that nobody clears @tag on that item concurrently.
+ *
+ *	Tags are set bottom-up with atomic bitops, stopping at the first level
+ *	that already has the tag; radix_tree_tag_clear() rechecks the child
+ *	after clearing a tag, so the tag cannot get lost on the way up.
+ *
+ *	Returns 1 if the tag is set all the way up to the root.  Returns 0 if
+ *	that could not be done locklessly, because the root tag was not yet set
+ *	or the tree was reshaped under us; the caller then has to take the tree
+ *	lock and use radix_tree_tag_set().
+ */
+int radix_tree_tag_set_lockless(struct radix_tree_root *root,
+			unsigned long index, unsigned int tag)
+{
+	struct radix_tree_node *path[RADIX_TREE_MAX_PATH];
+	int offsets[RADIX_TREE_MAX_PATH];
+	struct radix_tree_node *node, *top;
+	unsigned int height, shift;
+	int level = 0;
+
+	if (!root_tag_get(root, tag))
+		return 0;
+
+	/*
+	 * root->height is updated after root->rnode when the tree grows or
+	 * shrinks: take the height from the top node itself, which always
+	 * matches the node, as radix_tree_lookup_element() does.
+	 */
+	top = rcu_dereference_raw(root->rnode);
+	if (!radix_tree_is_indirect_ptr(top))
+		return 0;
+	node = indirect_to_ptr(top);
+	height = node->height;
+	if (index > radix_tree_maxindex(height))
+		return 0;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	for (;;) {
+		path[level] = node;
+		offsets[level] = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (!shift)
+			break;
+		node = rcu_dereference_raw(node->slots[offsets[level]]);
+		if (!node)
+			return 0;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		level++;
+	}
+
+	do {
+		node = path[level];
+		if (tag_get(node, tag, offsets[level]))
+			return 1;
+		tag_set(node, tag, offsets[level]);
+		smp_mb();
+	} while (level--);
+
+	/*
+	 * Tagged up to the top node.  If the tree grew or shrank meanwhile,
+	 * our top node is not (or no longer) the root's child, and the bits
+	 * above it are unknown.
+	 */
+	if (!root_tag_get(root, tag))
+		return 0;
+	smp_rmb();
+	return rcu_dereference_raw(root->rnode) == top;
+}
+EXPORT_SYMBOL(radix_tree_tag_set_lockless);
+
 /**
  * radix_tree_tag_get - get a tag on a radix tree node
  * @root:		radix tree root
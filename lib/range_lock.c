@@ -0,0 +1,105 @@
+/*
+ * Range locks, see include/linux/range_lock.h
+ *
+ * A range_lock is granted once no held range of the same tree overlaps
+ * it.  Waiters are woken on every unlock and recheck; there is no
+ * fairness between waiters of overlapping ranges.
+ */
+#include <linux/range_lock.h>
+#include <linux/sched.h>
+#include <linux/export.h>
+
+static int __range_is_locked(struct range_lock_tree *tree,
+			     unsigned long start, unsigned long end)
+{
+	struct range_lock *held;
+
+	list_for_each_entry(held, &tree->head, node)
+		if (held->start < end && start < held->end)
+			return 1;
+	return 0;
+}
+
+/**
+ * range_trylock - try to lock a range without waiting
+ * @tree: the set of ranges to lock in
+ * @lock: initialized range to lock
+ *
+ * Returns 1 if @lock is now held, 0 if an overlapping range is held.
+ */
+int range_trylock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	int locked = 0;
+
+	spin_lock(&tree->lock);
+	if (!__range_is_locked(tree, lock->start, lock->end)) {
+		list_add(&lock->node, &tree->head);
+		locked = 1;
+	}
+	spin_unlock(&tree->lock);
+
+	return locked;
+}
+EXPORT_SYMBOL(range_trylock);
+
+/**
+ * range_lock - lock a range, sleeping until it is free
+ * @tree: the set of ranges to lock in
+ * @lock: initialized range to lock
+ */
+void range_lock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	might_sleep();
+	wait_event(tree->wait, range_trylock(tree, lock));
+}
+EXPORT_SYMBOL(range_lock);
+
+/**
+ * range_unlock - release a range
+ * @tree: the set of ranges the lock is held in
+ * @lock: the held range
+ */
+void range_unlock(struct range_lock_tree *tree, struct range_lock *lock)
+{
+	spin_lock(&tree->lock);
+	list_del_init(&lock->node);
+	spin_unlock(&tree->lock);
+	wake_up_all(&tree->wait);
+}
+EXPORT_SYMBOL(range_unlock);
+
+/**
+ * range_is_locked - check whether any part of [start, end) is locked
+ * @tree: the set of ranges to check
+ * @start: first index of the range
+ * @end: index after the range
+ */
+int range_is_locked(struct range_lock_tree *tree,
+		    unsigned long start, unsigned long end)
+{
+	int locked;
+
+	spin_lock(&tree->lock);
+	locked = __range_is_locked(tree, start, end);
+	spin_unlock(&tree->lock);
+
+	return locked;
+}
+EXPORT_SYMBOL(range_is_locked);
+
+/**
+ * range_wait_unlocked - wait until no part of [start, end) is locked
+ * @tree: the set of ranges to check
+ * @start: first index of the range
+ * @end: index after the range
+ *
+ * Only meaningful if the caller otherwise prevents new locks on the
+ * range from being taken once this returns.
+ */
+void range_wait_unlocked(struct range_lock_tree *tree,
+			 unsigned long start, unsigned long end)
+{
+	might_sleep();
+	wait_event(tree->wait, !range_is_locked(tree, start, end));
+}
+EXPORT_SYMBOL(range_wait_unlocked);
@@ -0,0 +1,147 @@
+/*
+ * Symbol lookup and kprobe registration microbenchmark
+ *
+ * Picks symbols spread evenly over the kernel symbol table, then times
+ * kallsyms_lookup_name() on each of them, and register_kprobe() by
+ * symbol name, which does the same lookup, on each of them.  The
+ * average cost per symbol, in cycles, is printed for both.  The probes
+ * are registered disabled, so nothing is ever patched.  Load it
+ * with kallsyms.index=0 on the command line to compare with a linear
+ * scan of the symbol table.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/kallsyms.h>
+#include <linux/kprobes.h>
+#include <linux/math64.h>
+#include <linux/timex.h>
+
+static int nr_syms = 1000;
+module_param(nr_syms, int, 0444);
+MODULE_PARM_DESC(nr_syms, "Number of symbols looked up and probed");
+
+static char (*names)[KSYM_NAME_LEN];
+static struct kprobe *probes;
+static struct kprobe **registered;
+
+static unsigned long total_syms;
+
+static int __init count_sym(void *data, const char *name,
+			    struct module *mod, unsigned long addr)
+{
+	if (mod)
+		return 1;
+	total_syms++;
+	return 0;
+}
+
+static int __init pick_sym(void *data, const char *name,
+			   struct module *mod, unsigned long addr)
+{
+	unsigned long *pos = data;
+	unsigned long stride = total_syms / nr_syms;
+
+	if (mod)
+		return 1;
+	if (*pos % stride == 0 && *pos / stride < nr_syms)
+		strlcpy(names[*pos / stride], name, KSYM_NAME_LEN);
+	(*pos)++;
+	return 0;
+}
+
+static unsigned long long __init bench_lookup(int *found)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	unsigned long addr;
+	int i;
+
+	for (i = 0; i < nr_syms; i++) {
+		start = get_cycles();
+		addr = kallsyms_lookup_name(names[i]);
+		cycles += get_cycles() - start;
+		if (addr)
+			(*found)++;
+		cond_resched();
+	}
+	return cycles;
+}
+
+static unsigned long long __init bench_register(int *nr_registered)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i, ret;
+
+	for (i = 0; i < nr_syms; i++) {
+		probes[i].symbol_name = names[i];
+		/* arbitrary symbols include the int3 path: never arm them */
+		probes[i].flags = KPROBE_FLAG_DISABLED;
+		start = get_cycles();
+		ret = register_kprobe(&probes[i]);
+		cycles += get_cycles() - start;
+		if (!ret)
+			registered[(*nr_registered)++] = &probes[i];
+		cond_resched();
+	}
+	return cycles;
+}
+
+static int __init test_kallsyms_lookup_init(void)
+{
+	unsigned long long lookup, reg;
+	unsigned long pos = 0;
+	int found = 0, nr_registered = 0;
+	int ret = -ENOMEM;
+
+	if (nr_syms <= 0)
+		return -EINVAL;
+
+	kallsyms_on_each_symbol(count_sym, NULL);
+	if (total_syms < nr_syms)
+		nr_syms = total_syms;
+	if (!nr_syms)
+		return -EINVAL;
+
+	names = kcalloc(nr_syms, KSYM_NAME_LEN, GFP_KERNEL);
+	probes = kcalloc(nr_syms, sizeof(*probes), GFP_KERNEL);
+	registered = kcalloc(nr_syms, sizeof(*registered), GFP_KERNEL);
+	if (!names || !probes || !registered)
+		goto out;
+
+	kallsyms_on_each_symbol(pick_sym, &pos);
+
+	lookup = bench_lookup(&found);
+	reg = bench_register(&nr_registered);
+
+	if (nr_registered)
+		unregister_kprobes(registered, nr_registered);
+
+	pr_info("kallsyms_lookup_bench: %lu symbols, %d looked up (%d found): "
+		"%llu cycles per lookup\n",
+		total_syms, nr_syms, found, div64_u64(lookup, nr_syms));
+	pr_info("kallsyms_lookup_bench: %d kprobes registered by name "
+		"(%d accepted): %llu cycles per registration\n",
+		nr_syms, nr_registered, div64_u64(reg, nr_syms));
+	ret = 0;
+out:
+	kfree(registered);
+	kfree(probes);
+	kfree(names);
+	return ret;
+}
+
+static void __exit test_kallsyms_lookup_exit(void)
+{
+}
+
+module_init(test_kallsyms_lookup_init);
+module_exit(test_kallsyms_lookup_exit);
+MODULE_LICENSE("GPL");
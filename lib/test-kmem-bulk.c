@@ -0,0 +1,103 @@
+/*
+ * Bulk slab allocation microbenchmark
+ *
+ * For batch sizes of 1, 2, 4 ... MAX_BATCH objects, allocates and frees
+ * objects of a private cache first one at a time with kmem_cache_alloc()
+ * and kmem_cache_free(), then with kmem_cache_alloc_bulk() and
+ * kmem_cache_free_bulk().  The average cost per object, in cycles, is
+ * printed for both.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/timex.h>
+
+static int loops = 100000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of alloc/free batches per batch size");
+
+static int size = 256;
+module_param(size, int, 0444);
+MODULE_PARM_DESC(size, "Object size of the benchmarked cache");
+
+#define MAX_BATCH	256
+
+static void *objs[MAX_BATCH];
+
+static unsigned long long __init bench_single(struct kmem_cache *s,
+					      int batch)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i, n;
+
+	for (i = 0; i < loops; i++) {
+		start = get_cycles();
+		for (n = 0; n < batch; n++)
+			objs[n] = kmem_cache_alloc(s, GFP_KERNEL);
+		for (n = 0; n < batch; n++)
+			if (objs[n])
+				kmem_cache_free(s, objs[n]);
+		cycles += get_cycles() - start;
+		cond_resched();
+	}
+	return cycles;
+}
+
+static unsigned long long __init bench_bulk(struct kmem_cache *s, int batch)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		start = get_cycles();
+		if (kmem_cache_alloc_bulk(s, GFP_KERNEL, batch, objs))
+			kmem_cache_free_bulk(s, batch, objs);
+		cycles += get_cycles() - start;
+		cond_resched();
+	}
+	return cycles;
+}
+
+static int __init test_kmem_bulk_init(void)
+{
+	struct kmem_cache *s;
+	unsigned long long single, bulk;
+	int batch;
+
+	if (loops <= 0 || size <= 0)
+		return -EINVAL;
+
+	s = kmem_cache_create("kmem_bulk_bench", size, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	for (batch = 1; batch <= MAX_BATCH; batch *= 2) {
+		single = bench_single(s, batch);
+		bulk = bench_bulk(s, batch);
+		pr_info("kmem_bulk_bench: size %d, batch %3d: "
+			"%5llu cycles single, %5llu cycles bulk\n",
+			size, batch,
+			div64_u64(single, (u64)loops * batch),
+			div64_u64(bulk, (u64)loops * batch));
+	}
+
+	kmem_cache_destroy(s);
+	return 0;
+}
+
+static void __exit test_kmem_bulk_exit(void)
+{
+}
+
+module_init(test_kmem_bulk_init);
+module_exit(test_kmem_bulk_exit);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,183 @@
+/*
+ * Page allocator microbenchmark
+ *
+ * For each order from 0 to PAGE_ALLOC_COSTLY_ORDER + 1, and for 1, 2, 4 ...
+ * online CPUs, one kernel thread per CPU repeatedly allocates a batch of
+ * pages with alloc_pages() and frees them again with __free_pages().  The
+ * average cost of one allocation and of one free, in cycles, is printed.
+ *
+ * Orders above PAGE_ALLOC_COSTLY_ORDER are not cached on the per-cpu
+ * lists, so the last order shows the cost of going to the buddy lists.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/gfp.h>
+#include <linux/math64.h>
+#include <linux/mmzone.h>
+#include <linux/vmalloc.h>
+#include <linux/timex.h>
+
+static int loops = 10000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of alloc/free batches per thread");
+
+static int batch = 16;
+module_param(batch, int, 0444);
+MODULE_PARM_DESC(batch, "Pages allocated before freeing them again");
+
+#define MAX_BATCH	256
+
+struct bench_thread {
+	struct task_struct *task;
+	unsigned int order;
+	unsigned long long alloc_cycles;
+	unsigned long long free_cycles;
+	unsigned long nr_pages;
+	struct page *pages[MAX_BATCH];
+};
+
+static atomic_t bench_ready;
+static atomic_t bench_done;
+static DECLARE_COMPLETION(bench_completion);
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct page **pages = bt->pages;
+	cycles_t start;
+	int i, j, n;
+
+	/* Start all threads at about the same time */
+	atomic_dec(&bench_ready);
+	while (atomic_read(&bench_ready))
+		cond_resched();
+
+	for (i = 0; i < loops; i++) {
+		start = get_cycles();
+		for (n = 0; n < batch; n++) {
+			pages[n] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+					       bt->order);
+			if (!pages[n])
+				break;
+		}
+		bt->alloc_cycles += get_cycles() - start;
+
+		start = get_cycles();
+		for (j = 0; j < n; j++)
+			__free_pages(pages[j], bt->order);
+		bt->free_cycles += get_cycles() - start;
+
+		bt->nr_pages += n;
+		cond_resched();
+	}
+
+	if (atomic_dec_and_test(&bench_done))
+		complete(&bench_completion);
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+	return 0;
+}
+
+static int __init bench_run(struct bench_thread *threads, unsigned int order,
+			    int nr_cpus)
+{
+	unsigned long long alloc = 0, free = 0;
+	unsigned long nr_pages = 0;
+	int cpu, i = 0, ret = 0;
+
+	atomic_set(&bench_ready, nr_cpus);
+	atomic_set(&bench_done, nr_cpus);
+	INIT_COMPLETION(bench_completion);
+
+	for_each_online_cpu(cpu) {
+		struct bench_thread *bt = &threads[i];
+
+		if (i == nr_cpus)
+			break;
+		bt->order = order;
+		bt->alloc_cycles = bt->free_cycles = 0;
+		bt->nr_pages = 0;
+		bt->task = kthread_create_on_node(bench_thread_fn, bt,
+						  cpu_to_node(cpu),
+						  "page_alloc_bench/%d", cpu);
+		if (IS_ERR(bt->task)) {
+			ret = PTR_ERR(bt->task);
+			bt->task = NULL;
+			break;
+		}
+		kthread_bind(bt->task, cpu);
+		i++;
+	}
+
+	if (ret) {
+		while (i--)
+			kthread_stop(threads[i].task);
+		return ret;
+	}
+
+	for (i = 0; i < nr_cpus; i++)
+		wake_up_process(threads[i].task);
+	wait_for_completion(&bench_completion);
+
+	for (i = 0; i < nr_cpus; i++) {
+		kthread_stop(threads[i].task);
+		alloc += threads[i].alloc_cycles;
+		free += threads[i].free_cycles;
+		nr_pages += threads[i].nr_pages;
+	}
+
+	if (!nr_pages) {
+		pr_info("page_alloc_bench: order %u: no pages allocated\n",
+			order);
+		return 0;
+	}
+	pr_info("page_alloc_bench: order %u, %3d cpus: "
+		"%6llu cycles alloc, %6llu cycles free\n", order, nr_cpus,
+		div64_u64(alloc, nr_pages), div64_u64(free, nr_pages));
+	return 0;
+}
+
+static int __init test_page_alloc_init(void)
+{
+	struct bench_thread *threads;
+	int nr_cpus, max_cpus = num_online_cpus();
+	unsigned int order;
+	int ret = 0;
+
+	if (loops <= 0 || batch <= 0 || batch > MAX_BATCH)
+		return -EINVAL;
+
+	threads = vzalloc(max_cpus * sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	get_online_cpus();
+	for (order = 0; order <= PAGE_ALLOC_COSTLY_ORDER + 1; order++) {
+		for (nr_cpus = 1; ; nr_cpus = min(nr_cpus * 2, max_cpus)) {
+			ret = bench_run(threads, order, nr_cpus);
+			if (ret || nr_cpus == max_cpus)
+				break;
+		}
+		if (ret)
+			break;
+	}
+	put_online_cpus();
+	vfree(threads);
+	return ret;
+}
+
+static void __exit test_page_alloc_exit(void)
+{
+}
+
+module_init(test_page_alloc_init);
+module_exit(test_page_alloc_exit);
+MODULE_LICENSE("GPL");
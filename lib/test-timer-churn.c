@@ -0,0 +1,162 @@
+/*
+ * Timer churn microbenchmark
+ *
+ * Arms a large number of timers with timeouts spread from a few jiffies
+ * to a few minutes, the way TCP retransmit and keepalive timers are,
+ * then keeps re-arming random ones with mod_timer() and deleting and
+ * re-adding others while the short ones expire.  The average cost of
+ * each operation, in cycles, is printed, together with how many timers
+ * fired and how late, in jiffies, the latest of them was.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
+#include <linux/timex.h>
+#include <linux/atomic.h>
+
+static int nr_timers = 100000;
+module_param(nr_timers, int, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of timers armed at once");
+
+static int loops = 1000000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of mod_timer() and del_timer() calls");
+
+static struct timer_list *timers;
+static atomic_t nr_fired;
+static atomic_t max_late;
+
+static void churn_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = (struct timer_list *)data;
+	int late = jiffies - timer->expires;
+	int old;
+
+	atomic_inc(&nr_fired);
+	old = atomic_read(&max_late);
+	while (late > old) {
+		int prev = atomic_cmpxchg(&max_late, old, late);
+
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
+/* One timer in four is short, the rest up to two minutes out */
+static unsigned long __init churn_timeout(void)
+{
+	u32 r = random32();
+
+	if (!(r & 3))
+		return 1 + (r >> 2) % (HZ / 10);
+	return HZ / 5 + (r >> 2) % (120 * HZ);
+}
+
+static unsigned long long __init bench_arm(void)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i;
+
+	for (i = 0; i < nr_timers; i++) {
+		start = get_cycles();
+		mod_timer(&timers[i], jiffies + churn_timeout());
+		cycles += get_cycles() - start;
+	}
+	return cycles;
+}
+
+static unsigned long long __init bench_mod(void)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		struct timer_list *timer = &timers[random32() % nr_timers];
+
+		start = get_cycles();
+		mod_timer(timer, jiffies + churn_timeout());
+		cycles += get_cycles() - start;
+		if (!(i & 1023))
+			cond_resched();
+	}
+	return cycles;
+}
+
+static unsigned long long __init bench_del(void)
+{
+	unsigned long long cycles = 0;
+	cycles_t start;
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		struct timer_list *timer = &timers[random32() % nr_timers];
+
+		start = get_cycles();
+		del_timer(timer);
+		cycles += get_cycles() - start;
+		mod_timer(timer, jiffies + churn_timeout());
+		if (!(i & 1023))
+			cond_resched();
+	}
+	return cycles;
+}
+
+static int __init test_timer_churn_init(void)
+{
+	unsigned long long arm, mod, del;
+	int i;
+
+	if (nr_timers <= 0 || loops <= 0)
+		return -EINVAL;
+
+	timers = vzalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_timers; i++)
+		setup_timer(&timers[i], churn_timer_fn,
+			    (unsigned long)&timers[i]);
+
+	arm = bench_arm();
+	mod = bench_mod();
+	del = bench_del();
+
+	/* let the short timers run for a while before tearing down */
+	schedule_timeout_interruptible(HZ / 2);
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timers[i]);
+
+	pr_info("timer_churn_bench: %d timers, %d loops: %llu cycles arm, "
+		"%llu cycles mod, %llu cycles del\n",
+		nr_timers, loops,
+		div64_u64(arm, nr_timers),
+		div64_u64(mod, loops),
+		div64_u64(del, loops));
+	pr_info("timer_churn_bench: %d timers fired, at most %d jiffies late\n",
+		atomic_read(&nr_fired), atomic_read(&max_late));
+
+	vfree(timers);
+	return 0;
+}
+
+static void __exit test_timer_churn_exit(void)
+{
+}
+
+module_init(test_timer_churn_init);
+module_exit(test_timer_churn_exit);
+MODULE_LICENSE("GPL");
@@ -100,6 +100,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "BdiReadahead:       %10lu kB\n"
+		   "BdiReadaheadHits:   %10lu kB\n"
+		   "BdiReadaheadWaste:  %10lu kB\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -113,6 +116,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_PAGES)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_HITS)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_WASTE)),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -674,6 +676,256 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 }
 
 
+/*
+ * kcompactd checks the fragmentation index for pageblock-order
+ * allocations in its node this often, in milliseconds, and compacts
+ * proactively when it is above sysctl_extfrag_threshold.  0 disables
+ * proactive compaction; kcompactd then only runs when woken up.
+ */
+int sysctl_compact_proactive_millisecs = 500;
+
+/* Minimum time between two compaction runs of kcompactd */
+#define KCOMPACTD_MIN_INTERVAL	(HZ / 10)
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+	struct zone *zone;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Is any zone of the node fragmented enough that a pageblock-order
+ * allocation, e.g. a transparent huge page, would fail even though
+ * there is enough free memory?
+ */
+static bool kcompactd_node_fragmented(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+
+	for (zoneid = 0; zoneid < pgdat->nr_zones; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (fragmentation_index(zone, pageblock_order) <=
+						sysctl_extfrag_threshold)
+			continue;
+
+		if (compaction_suitable(zone, pageblock_order) ==
+							COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = order,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = true,
+	};
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		int status;
+
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		if (kthread_should_stop())
+			return;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      classzone_idx, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE) {
+			/*
+			 * The whole zone was scanned without forming a free
+			 * page of the requested order, back off.
+			 */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+/*
+ * A high-order allocation needed, or had to wait for, reclaim or
+ * direct compaction: wake the node's kcompactd to compact for the
+ * following ones in the background.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static void kcompactd_try_to_sleep(pg_data_t *pgdat)
+{
+	long timeout = MAX_SCHEDULE_TIMEOUT;
+	DEFINE_WAIT(wait);
+
+	if (sysctl_compact_proactive_millisecs)
+		timeout = msecs_to_jiffies(sysctl_compact_proactive_millisecs);
+
+	prepare_to_wait(&pgdat->kcompactd_wait, &wait, TASK_INTERRUPTIBLE);
+	if (!kcompactd_work_requested(pgdat))
+		schedule_timeout(timeout);
+	finish_wait(&pgdat->kcompactd_wait, &wait);
+}
+
+/*
+ * The background compaction daemon, started as a kernel thread
+ * from the init process.
+ *
+ * It compacts the zones of its node when woken up for a high-order
+ * allocation, and every sysctl_compact_proactive_millisecs when they
+ * are fragmented for pageblock-order allocations, so that transparent
+ * huge pages and large atomic allocations find free pages of their
+ * order rather than stalling in direct compaction.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	int order, classzone_idx;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		kcompactd_try_to_sleep(pgdat);
+
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+		pgdat->kcompactd_max_order = 0;
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+		if (try_to_freeze())
+			continue;
+		if (kthread_should_stop())
+			break;
+
+		if (order) {
+			count_vm_event(KCOMPACTD_WAKE);
+			kcompactd_do_work(pgdat, order, classzone_idx);
+		} else if (sysctl_compact_proactive_millisecs &&
+			   kcompactd_node_fragmented(pgdat)) {
+			count_vm_event(KCOMPACTD_PROACTIVE);
+			kcompactd_do_work(pgdat, pageblock_order,
+					  pgdat->nr_zones - 1);
+		} else
+			continue;
+
+		/* Rate limit: wakeups meanwhile are serviced afterwards */
+		schedule_timeout_interruptible(KCOMPACTD_MIN_INTERVAL);
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
+
 /* Compact all zones within a node */
 static int compact_node(int nid)
 {
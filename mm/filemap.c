@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
+#include <linux/khugepaged.h>
 #include "internal.h"
 
 /*
@@ -493,6 +494,69 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add a batch of new pages to the pagecache
+ * @pages:	the pages to add, with their ->index already set
+ * @nr_pages:	number of pages in @pages
+ * @mapping:	the pages' address_space
+ * @gfp_mask:	page allocation mode
+ *
+ * Works like add_to_page_cache_lru() on each page in turn, but takes
+ * mapping->tree_lock only once for the whole batch.  Stops at the first page
+ * that cannot be added, e.g. because it is already cached or the radix tree
+ * ran out of preallocated nodes.
+ *
+ * Returns the number of pages added from the start of @pages: those are
+ * locked and on the LRU, the rest are left untouched and can be retried with
+ * add_to_page_cache_lru() to find out what went wrong.
+ */
+int add_to_page_cache_lru_batch(struct page **pages, int nr_pages,
+				struct address_space *mapping, gfp_t gfp_mask)
+{
+	int nr_charged, nr_added = 0;
+	int i;
+
+	/* Charging may reclaim, so do it before taking any locks */
+	for (nr_charged = 0; nr_charged < nr_pages; nr_charged++) {
+		struct page *page = pages[nr_charged];
+
+		VM_BUG_ON(PageSwapBacked(page));
+		if (mem_cgroup_cache_charge(page, current->mm,
+					    gfp_mask & GFP_RECLAIM_MASK))
+			break;
+		__set_page_locked(page);
+	}
+
+	if (nr_charged && !radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM)) {
+		spin_lock_irq(&mapping->tree_lock);
+		for (; nr_added < nr_charged; nr_added++) {
+			struct page *page = pages[nr_added];
+
+			page_cache_get(page);
+			page->mapping = mapping;
+			if (radix_tree_insert(&mapping->page_tree,
+					      page->index, page)) {
+				page->mapping = NULL;
+				page_cache_release(page);
+				break;
+			}
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		radix_tree_preload_end();
+	}
+
+	for (i = nr_added; i < nr_charged; i++) {
+		mem_cgroup_uncharge_cache_page(pages[i]);
+		__clear_page_locked(pages[i]);
+	}
+	for (i = 0; i < nr_added; i++)
+		lru_cache_add_file(pages[i]);
+	return nr_added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -1759,8 +1823,128 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map page cache pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	pgoff..max_pgoff range to map, and the pte for pgoff
+ *
+ * Called with the page table lock held, so it only maps pages which are
+ * already uptodate in the page cache and can be locked without waiting.
+ * Pages under readahead are left to filemap_fault(), so that the next
+ * readahead window is still triggered.  Returns the number of ptes set.
+ */
+int filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	struct file_ra_state *ra = &file->f_ra;
+	unsigned long address = (unsigned long) vmf->virtual_address;
+	pgoff_t index = vmf->pgoff;
+	struct pagevec pvec;
+	unsigned long addr;
+	loff_t size;
+	pte_t *pte;
+	int mapped = 0;
+	int i;
+
+	pagevec_init(&pvec, 0);
+	while (index <= vmf->max_pgoff &&
+	       pagevec_lookup(&pvec, mapping, index,
+			min_t(pgoff_t, vmf->max_pgoff - index + 1,
+			      PAGEVEC_SIZE))) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			/* We rely upon deletion not changing page->index */
+			index = page->index;
+			if (index > vmf->max_pgoff)
+				break;
+			index++;
+
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				continue;
+			if (!trylock_page(page))
+				continue;
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+
+			size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1)
+				>> PAGE_CACHE_SHIFT;
+			if (page->index >= size)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (ra->mmap_miss > 0)
+				ra->mmap_miss--;
+			addr = address + (page->index - vmf->pgoff) * PAGE_SIZE;
+			/* The pte keeps its own reference, pagevec drops ours */
+			get_page(page);
+			do_set_pte(vma, addr, page, pte);
+			mapped++;
+unlock:
+			unlock_page(page);
+		}
+		pagevec_release(&pvec);
+	}
+	return mapped;
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/**
+ * filemap_pmd_fault - map a huge page sized block of page cache with a pmd
+ * @vma:	vma in which the fault was taken
+ * @address:	faulting address
+ * @pmd:	empty pmd covering @address
+ * @flags:	fault flags
+ *
+ * Nothing is read or allocated here: the pmd is only set up if the whole
+ * aligned block is already cached in physically contiguous pages, as left
+ * behind by khugepaged.  The mapping is read-only; a write fault splits
+ * it so that ->page_mkwrite is still called for each page.
+ */
+int filemap_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+		      pmd_t *pmd, unsigned int flags)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	pgoff_t index;
+	int aligned;
+
+	/* let khugepaged know about the mapping even if we fall back */
+	if (unlikely(khugepaged_enter(vma)))
+		return VM_FAULT_OOM;
+	if (flags & FAULT_FLAG_WRITE)
+		return VM_FAULT_FALLBACK;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	/* Cheap test on the first page before looking up the whole block */
+	index = vma->vm_pgoff + ((haddr - vma->vm_start) >> PAGE_SHIFT);
+	page = find_get_page(mapping, index);
+	if (!page)
+		return VM_FAULT_FALLBACK;
+	aligned = !(page_to_pfn(page) & (HPAGE_PMD_NR - 1));
+	page_cache_release(page);
+	if (!aligned)
+		return VM_FAULT_FALLBACK;
+
+	return do_huge_pmd_file_page(vma, address, pmd);
+}
+EXPORT_SYMBOL(filemap_pmd_fault);
+#endif
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= filemap_pmd_fault,
+#endif
 };
 
 /* This is used for a general mmap of a disk file */
@@ -17,6 +17,9 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/migrate.h>
+#include <linux/pagemap.h>
+#include <linux/file.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -294,6 +297,23 @@ static ssize_t defrag_store(struct kobject *kobj,
 static struct kobj_attribute defrag_attr =
 	__ATTR(defrag, 0644, defrag_show, defrag_store);
 
+/* huge pages for SysV shm and shared anonymous mappings */
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return single_flag_show(kobj, attr, buf,
+				TRANSPARENT_HUGEPAGE_SHMEM_FLAG);
+}
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return single_flag_store(kobj, attr, buf, count,
+				 TRANSPARENT_HUGEPAGE_SHMEM_FLAG);
+}
+static struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+
 #ifdef CONFIG_DEBUG_VM
 static ssize_t debug_cow_show(struct kobject *kobj,
 				struct kobj_attribute *attr, char *buf)
@@ -315,6 +335,7 @@ static struct kobj_attribute debug_cow_attr =
 static struct attribute *hugepage_attr[] = {
 	&enabled_attr.attr,
 	&defrag_attr.attr,
+	&shmem_enabled_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
 #endif
@@ -748,6 +769,112 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map the HPAGE_PMD_NR pages of a file around @address with a huge pmd,
+ * if they are all in the page cache, uptodate and physically contiguous
+ * starting at a HPAGE_PMD_NR aligned pfn.  Called by ->pmd_fault.
+ *
+ * These are not compound pages: each keeps its own page cache reference
+ * and mapcount, and the pmd holds one reference and mapcount on each of
+ * them.  Splitting the pmd just zaps it so that the pages are faulted
+ * back in with ptes, and truncation, reclaim and migration of the pages
+ * themselves work as usual.
+ *
+ * Only swap backed pages are mapped writable: they are dirtied here, as
+ * there is no dirty tracking for a huge pmd.  Others are mapped read-only
+ * and a write fault splits the pmd to go through ->page_mkwrite.
+ */
+int do_huge_pmd_file_page(struct vm_area_struct *vma, unsigned long address,
+			  pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page **pages;
+	pgtable_t pgtable;
+	unsigned long pfn;
+	pgoff_t index;
+	pmd_t entry;
+	int i, nr, locked = 0;
+	int ret = VM_FAULT_FALLBACK;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return ret;
+	if (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR))
+		return ret;
+	index = vma->vm_pgoff + ((haddr - vma->vm_start) >> PAGE_SHIFT);
+	if (index & (HPAGE_PMD_NR - 1))
+		return ret;
+	if (unlikely(khugepaged_enter(vma)))
+		return VM_FAULT_OOM;
+
+	pages = kmalloc(sizeof(struct page *) * HPAGE_PMD_NR, GFP_KERNEL);
+	if (unlikely(!pages))
+		return ret;
+	nr = find_get_pages_contig(mapping, index, HPAGE_PMD_NR, pages);
+	if (nr != HPAGE_PMD_NR)
+		goto out_put;
+	pfn = page_to_pfn(pages[0]);
+	if (pfn & (HPAGE_PMD_NR - 1))
+		goto out_put;
+
+	/* The page locks keep truncation away until the pmd is set */
+	for (locked = 0; locked < nr; locked++) {
+		struct page *page = pages[locked];
+
+		if (page_to_pfn(page) != pfn + locked ||
+		    !PageUptodate(page) || !trylock_page(page))
+			goto out_unlock;
+		if (page->mapping != mapping || PageHWPoison(page)) {
+			unlock_page(page);
+			goto out_unlock;
+		}
+	}
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		goto out_unlock;
+
+	entry = pmd_mkhuge(mk_pmd(pages[0], vma->vm_page_prot));
+	/* private mappings must take the write fault to break COW */
+	if (PageSwapBacked(pages[0]) && (vma->vm_flags & VM_SHARED)) {
+		for (i = 0; i < nr; i++)
+			set_page_dirty(pages[i]);
+		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	} else
+		entry = pmd_wrprotect(entry);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		goto out_unlock;
+	}
+	for (i = 0; i < nr; i++)
+		page_add_file_rmap(pages[i]);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+	count_vm_event(THP_FILE_MAPPED);
+
+	/* the page references are now held by the pmd */
+	for (i = 0; i < nr; i++)
+		unlock_page(pages[i]);
+	kfree(pages);
+	return VM_FAULT_NOPAGE;
+
+out_unlock:
+	while (locked--)
+		unlock_page(pages[locked]);
+out_put:
+	for (i = 0; i < nr; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+	return ret;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -781,6 +908,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* the child faults file pages back in on its own */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -1003,7 +1136,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	VM_BUG_ON(PageAnon(page) && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -1018,9 +1151,13 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
-	if (flags & FOLL_GET)
-		get_page_foll(page);
+	if (flags & FOLL_GET) {
+		/* see do_huge_pmd_file_page() */
+		if (PageCompound(page))
+			get_page_foll(page);
+		else
+			get_page(page);
+	}
 
 out:
 	return page;
@@ -1040,17 +1177,29 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
+			int i, nr = 1;
 			pgtable = get_pmd_huge_pte(tlb->mm);
 			page = pmd_page(*pmd);
 			pmd_clear(pmd);
 			tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
-			page_remove_rmap(page);
-			VM_BUG_ON(page_mapcount(page) < 0);
-			add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
-			VM_BUG_ON(!PageHead(page));
+			if (PageAnon(page)) {
+				page_remove_rmap(page);
+				VM_BUG_ON(page_mapcount(page) < 0);
+				add_mm_counter(tlb->mm, MM_ANONPAGES,
+					       -HPAGE_PMD_NR);
+				VM_BUG_ON(!PageHead(page));
+			} else {
+				/* see do_huge_pmd_file_page() */
+				nr = HPAGE_PMD_NR;
+				for (i = 0; i < nr; i++)
+					page_remove_rmap(page + i);
+				add_mm_counter(tlb->mm, MM_FILEPAGES,
+					       -HPAGE_PMD_NR);
+			}
 			tlb->mm->nr_ptes--;
 			spin_unlock(&tlb->mm->page_table_lock);
-			tlb_remove_page(tlb, page);
+			for (i = 0; i < nr; i++)
+				tlb_remove_page(tlb, page + i);
 			pte_free(tlb->mm, pgtable);
 			ret = 1;
 		}
@@ -1644,15 +1793,16 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
-	if (!vma->anon_vma)
+	if (vma->vm_ops) {
+		/* khugepaged only works on file mappings with ->pmd_fault */
+		if (!vma->vm_ops->pmd_fault || vma->vm_flags & VM_NO_THP)
+			return 0;
+	} else if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
 		 * page fault if needed.
 		 */
 		return 0;
-	if (vma->vm_ops)
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
 	/*
 	 * If is_pfn_mapping() is true is_learn_pfn_mapping() must be
 	 * true too, verify it here.
@@ -2102,6 +2252,208 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+static pmd_t *huge_pmd_offset(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+struct collapse_target {
+	struct page *base;
+	pgoff_t index;
+	DECLARE_BITMAP(used, HPAGE_PMD_NR);
+};
+
+static struct page *collapse_new_page(struct page *page, unsigned long private,
+				      int **result)
+{
+	struct collapse_target *target = (struct collapse_target *)private;
+	unsigned long i = page->index - target->index;
+
+	/* A target freed by a failed attempt can't be handed out again */
+	if (i >= HPAGE_PMD_NR || test_and_set_bit(i, target->used))
+		return NULL;
+	return target->base + i;
+}
+
+/*
+ * Migrate the HPAGE_PMD_NR page cache pages in @pages into a freshly
+ * allocated, suitably aligned block of order-0 pages, so that the fault
+ * path can map them with a pmd.  Consumes the references on @pages.
+ */
+static void collapse_file_pages(struct page **pages, pgoff_t index)
+{
+	struct collapse_target *target;
+	LIST_HEAD(pagelist);
+	struct page *page;
+	int i, isolated = 0;
+	gfp_t gfp;
+
+	target = kzalloc(sizeof(*target), GFP_KERNEL);
+	if (!target)
+		goto out_put;
+
+	gfp = alloc_hugepage_gfpmask(khugepaged_defrag(), 0) & ~__GFP_COMP;
+	page = alloc_pages_exact_node(page_to_nid(pages[0]), gfp,
+				      HPAGE_PMD_ORDER);
+	if (unlikely(!page)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		goto out_put;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(page, HPAGE_PMD_ORDER);
+	target->base = page;
+	target->index = index;
+
+	migrate_prep();
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = pages[i];
+		if (!isolate_lru_page(page)) {
+			list_add_tail(&page->lru, &pagelist);
+			inc_zone_page_state(page, NR_ISOLATED_ANON +
+					    page_is_file_cache(page));
+			isolated++;
+		}
+		page_cache_release(page);
+	}
+
+	if (isolated == HPAGE_PMD_NR &&
+	    !migrate_pages(&pagelist, collapse_new_page,
+			   (unsigned long)target, false, MIGRATE_SYNC_LIGHT))
+		khugepaged_pages_collapsed++;
+	else
+		putback_lru_pages(&pagelist);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!test_bit(i, target->used))
+			__free_page(target->base + i);
+	kfree(target);
+	return;
+
+out_put:
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_cache_release(pages[i]);
+	kfree(target);
+}
+
+/*
+ * Free the page table mapping the block at @address with ptes, so that
+ * the next fault maps it with a pmd.  Called with mmap_sem held for write;
+ * the i_mmap_mutex keeps rmap walks out of the page table being freed.
+ */
+static void retract_page_table(struct mm_struct *mm, unsigned long address,
+			       struct address_space *mapping, pgoff_t index)
+{
+	struct vm_area_struct *vma;
+	pgtable_t pgtable;
+	pmd_t *pmd;
+
+	vma = find_vma(mm, address);
+	if (!vma || vma->vm_start > address ||
+	    address + HPAGE_PMD_SIZE > vma->vm_end)
+		return;
+	if (!vma->vm_file || vma->vm_file->f_mapping != mapping ||
+	    vma->anon_vma || (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR)))
+		return;
+	if (vma->vm_pgoff + ((address - vma->vm_start) >> PAGE_SHIFT) != index)
+		return;
+
+	pmd = huge_pmd_offset(mm, address);
+	if (!pmd || pmd_trans_huge(*pmd))
+		return;
+
+	zap_page_range(vma, address, HPAGE_PMD_SIZE, NULL);
+
+	mutex_lock(&mapping->i_mmap_mutex);
+	spin_lock(&mm->page_table_lock);
+	pgtable = pmd_pgtable(*pmd);
+	pmd_clear(pmd);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+	mutex_unlock(&mapping->i_mmap_mutex);
+	pte_free(mm, pgtable);
+}
+
+/*
+ * Page cache counterpart of khugepaged_scan_pmd: only blocks which are
+ * fully cached are considered, nothing is read in.  Returns 1 if the
+ * mmap_sem was released.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	struct file *file;
+	struct page **pages;
+	unsigned long pfn;
+	pgoff_t index;
+	pmd_t *pmd;
+	int i, nr, contig;
+
+	index = vma->vm_pgoff + ((address - vma->vm_start) >> PAGE_SHIFT);
+	if (index & (HPAGE_PMD_NR - 1))
+		return 0;
+	pmd = huge_pmd_offset(mm, address);
+	if (pmd && pmd_trans_huge(*pmd))
+		return 0;
+
+	pages = kmalloc(sizeof(struct page *) * HPAGE_PMD_NR, GFP_KERNEL);
+	if (unlikely(!pages))
+		return 0;
+	nr = find_get_pages_contig(mapping, index, HPAGE_PMD_NR, pages);
+	if (nr != HPAGE_PMD_NR)
+		goto out_put;
+
+	pfn = page_to_pfn(pages[0]);
+	contig = !(pfn & (HPAGE_PMD_NR - 1));
+	for (i = 1; contig && i < nr; i++)
+		if (page_to_pfn(pages[i]) != pfn + i)
+			contig = 0;
+	/* Already in place and not mapped by ptes here: nothing to do */
+	if (contig && !pmd)
+		goto out_put;
+
+	file = vma->vm_file;
+	get_file(file);
+	up_read(&mm->mmap_sem);
+
+	if (contig) {
+		for (i = 0; i < nr; i++)
+			page_cache_release(pages[i]);
+	} else
+		collapse_file_pages(pages, index);
+	kfree(pages);
+
+	down_write(&mm->mmap_sem);
+	if (!khugepaged_test_exit(mm))
+		retract_page_table(mm, address, mapping, index);
+	up_write(&mm->mmap_sem);
+	fput(file);
+	return 1;
+
+out_put:
+	for (i = 0; i < nr; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+	return 0;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
@@ -2149,7 +2501,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
+		if (vma->vm_ops) {
+			/* page cache: only mappings not holding anon pages */
+			if (!vma->vm_ops->pmd_fault || vma->anon_vma ||
+			    (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR |
+					      VM_NO_THP)))
+				goto skip;
+		} else if (!vma->anon_vma)
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -2179,9 +2537,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma->vm_ops)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2374,8 +2736,42 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * A huge pmd mapping file pages is split by zapping it: the pages are
+ * faulted back in with ptes.  The pte page deposited for the pmd is put
+ * in place, empty, so that callers find a regular pmd either way.
+ */
+static void split_file_huge_pmd(struct vm_area_struct *vma,
+				unsigned long haddr, pmd_t *pmd)
 {
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
+	_pmd = pmdp_clear_flush_notify(vma, haddr, pmd);
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, pmd, pgtable);
+	spin_unlock(&mm->page_table_lock);
+
+	page = pmd_page(_pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page_remove_rmap(page + i);
+		page_cache_release(page + i);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+}
+
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2385,6 +2781,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	}
 	page = pmd_page(*pmd);
 	VM_BUG_ON(!page_count(page));
+	if (!PageAnon(page)) {
+		spin_unlock(&mm->page_table_lock);
+		split_file_huge_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+		return;
+	}
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
 
@@ -2394,31 +2795,46 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
+{
+	struct vm_area_struct *vma;
+
+	vma = find_vma(mm, address);
+	BUG_ON(vma == NULL);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
 static void split_huge_page_address(struct mm_struct *mm,
 				    unsigned long address)
 {
-	pgd_t *pgd;
-	pud_t *pud;
 	pmd_t *pmd;
 
 	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
 
-	pgd = pgd_offset(mm, address);
-	if (!pgd_present(*pgd))
-		return;
-
-	pud = pud_offset(pgd, address);
-	if (!pud_present(*pud))
-		return;
-
-	pmd = pmd_offset(pud, address);
-	if (!pmd_present(*pmd))
+	pmd = huge_pmd_offset(mm, address);
+	if (!pmd)
 		return;
 	/*
 	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
 	 * materialize from under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd_mm(mm, address, pmd);
+}
+
+/*
+ * Called from rmap walks of file pages, with the i_mmap_mutex held
+ * but without the mmap_sem: the mutex keeps the page tables of the
+ * vma from being freed under us.
+ */
+void split_file_huge_page_address(struct vm_area_struct *vma,
+				  unsigned long address)
+{
+	pmd_t *pmd;
+
+	pmd = huge_pmd_offset(vma->vm_mm, address);
+	if (pmd)
+		split_huge_page_pmd(vma, address, pmd);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -16,6 +16,12 @@
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct vm_area_struct *get_vma(struct mm_struct *mm,
+				      unsigned long addr);
+extern void put_vma(struct vm_area_struct *vma);
+#endif
+
 static inline void set_page_count(struct page *page, int v)
 {
 	atomic_set(&page->_count, v);
@@ -99,6 +105,25 @@ extern void prep_compound_page(struct page *page, unsigned long order);
 #ifdef CONFIG_MEMORY_FAILURE
 extern bool is_free_buddy_page(struct page *page);
 #endif
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+extern void init_deferred_reserved_pages(void);
+extern unsigned long free_memblock_reserved_array(void);
+
+/* The first pfn of a node whose struct page is initialised late */
+static inline unsigned long node_first_deferred_pfn(int nid)
+{
+	return NODE_DATA(nid)->first_deferred_pfn;
+}
+#else
+static inline void init_deferred_reserved_pages(void)
+{
+}
+
+static inline unsigned long node_first_deferred_pfn(int nid)
+{
+	return ULONG_MAX;
+}
+#endif
 
 
 /*
@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -68,7 +70,8 @@
  * 1) The unstable tree is flushed every time KSM completes scanning all
  *    memory areas, and then the tree is rebuilt again from the beginning.
  * 2) KSM will only insert into the unstable tree, pages whose hash value
- *    has not changed since the previous scan of all memory areas.
+ *    has not changed since the previous scan of all memory areas.  Pages
+ *    whose hash value did change are not even searched in the stable tree.
  * 3) The unstable tree is a RedBlack Tree - so its balancing is based on the
  *    colors of the nodes and not on their contents, assuring that even when
  *    the tree gets "corrupted" it won't get out of balance, so scanning time
@@ -86,12 +89,16 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @nr_merged: number of pages merged during the current scan of this mm
+ * @idle_scans: number of consecutive scans of this mm that merged nothing
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned long nr_merged;
+	unsigned int idle_scans;
 };
 
 /**
@@ -189,6 +196,20 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Number of threads, ksmd included, calculating checksums of a batch */
+static unsigned int ksm_scan_threads = 1;
+#define KSM_MAX_SCAN_THREADS	16
+
+/* Pages collected from an mm and checksummed before they are merged */
+#define KSM_SCAN_BATCH		64
+
+/* mms that merged nothing last time are scanned every this many scans */
+#define KSM_IDLE_SCAN_INTERVAL	4
+
+/* The number of pages merged, and cpu time spent on it, since boot */
+static unsigned long ksm_pages_merged;
+static u64 ksm_scan_cpu_ns;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -669,12 +690,27 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only serves to tell volatile pages from those that kept
+ * their contents since the last scan: pages are always compared in full
+ * before they are merged.  So rather than hashing the whole page, hash
+ * one word out of every cacheline, which is enough to notice the common
+ * kinds of modification at a fraction of the cost.
+ */
+#define CHECKSUM_STRIDE	(L1_CACHE_BYTES / sizeof(u32))
+#define CHECKSUM_WORDS	(PAGE_SIZE / L1_CACHE_BYTES)
+
 static u32 calc_checksum(struct page *page)
 {
+	u32 sample[CHECKSUM_WORDS];
 	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u32 *addr = kmap_atomic(page, KM_USER0);
+	int i;
+
+	for (i = 0; i < CHECKSUM_WORDS; i++)
+		sample[i] = addr[i * CHECKSUM_STRIDE + (i % CHECKSUM_STRIDE)];
 	kunmap_atomic(addr, KM_USER0);
+	checksum = jhash2(sample, CHECKSUM_WORDS, 17);
 	return checksum;
 }
 
@@ -1167,18 +1203,30 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @checksum: the current checksum of the page
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       u32 checksum)
 {
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
 	int err;
 
 	remove_rmap_item_from_tree(rmap_item);
 
+	/*
+	 * If the hash value of the page has changed from the last time
+	 * we calculated it, this page is changing frequently: therefore we
+	 * don't want to waste our time searching either tree for it.  A
+	 * page seen for the first time is still looked up in the stable tree.
+	 */
+	if (rmap_item->oldchecksum && rmap_item->oldchecksum != checksum) {
+		rmap_item->oldchecksum = checksum;
+		return;
+	}
+
 	/* We first start with searching the page inside the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage) {
@@ -1191,18 +1239,18 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_scan.mm_slot->nr_merged++;
+			ksm_pages_merged++;
 		}
 		put_page(kpage);
 		return;
 	}
 
 	/*
-	 * If the hash value of the page has changed from the last time
-	 * we calculated it, this page is changing frequently: therefore we
-	 * don't want to insert it in the unstable tree, and we don't want
-	 * to waste our time searching for something identical to it there.
+	 * Only insert the page in the unstable tree, and search for
+	 * something identical to it there, once its contents have been
+	 * seen unchanged across a full scan.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1227,6 +1275,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_scan.mm_slot->nr_merged++;
+				ksm_pages_merged++;
 			}
 			unlock_page(kpage);
 
@@ -1272,7 +1322,29 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * An mm that is skipped for a full scan must not keep rmap_items that
+ * claim to be in the unstable tree of the previous scan: it is gone.
+ */
+static void forget_unstable_rmap_items(struct mm_slot *mm_slot)
+{
+	struct rmap_item *rmap_item;
+
+	for (rmap_item = mm_slot->rmap_list; rmap_item;
+	     rmap_item = rmap_item->rmap_list)
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+}
+
+/*
+ * Returns the rmap_item of the next page to scan, with *page holding a
+ * reference to that page, or NULL when the full scan has completed.  If
+ * @batch_pending, the caller still holds pages of the current mm to be
+ * merged: rather than finishing with that mm, ERR_PTR(-EAGAIN) is
+ * returned then, to be called again once those have been dealt with.
+ */
+static struct rmap_item *scan_get_next_rmap_item(struct page **page,
+						 bool batch_pending)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
@@ -1309,6 +1381,24 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		if (slot == &ksm_mm_head)
 			return NULL;
 next_mm:
+		/*
+		 * Give priority to the mms which recently produced merges:
+		 * those which did not are only scanned once every
+		 * KSM_IDLE_SCAN_INTERVAL full scans.
+		 */
+		if (slot->idle_scans && !ksm_test_exit(slot->mm) &&
+		    ksm_scan.seqnr % KSM_IDLE_SCAN_INTERVAL) {
+			forget_unstable_rmap_items(slot);
+			spin_lock(&ksm_mmlist_lock);
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			ksm_scan.mm_slot = slot;
+			spin_unlock(&ksm_mmlist_lock);
+			if (slot != &ksm_mm_head)
+				goto next_mm;
+			ksm_scan.seqnr++;
+			return NULL;
+		}
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
 	}
@@ -1358,6 +1448,21 @@ next_mm:
 		}
 	}
 
+	/*
+	 * The rmap_items of the pages the caller holds would be freed below
+	 * if the mm is exiting: let it merge those pages first.
+	 */
+	if (batch_pending) {
+		up_read(&mm->mmap_sem);
+		return ERR_PTR(-EAGAIN);
+	}
+
+	if (slot->nr_merged)
+		slot->idle_scans = 0;
+	else
+		slot->idle_scans++;
+	slot->nr_merged = 0;
+
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -1403,6 +1508,75 @@ next_mm:
 	return NULL;
 }
 
+/*
+ * Pages are collected from one mm into a batch, their checksums are
+ * calculated by up to ksm_scan_threads threads in parallel, then they
+ * are searched in the trees and merged by ksmd one after the other.
+ */
+struct ksm_scan_item {
+	struct page *page;
+	struct rmap_item *rmap_item;
+	u32 checksum;
+};
+static struct ksm_scan_item ksm_scan_batch[KSM_SCAN_BATCH];
+
+struct ksm_checksum_work {
+	struct work_struct work;
+	int start;
+	int end;
+	u64 runtime;
+};
+static struct ksm_checksum_work ksm_checksum_work[KSM_MAX_SCAN_THREADS];
+
+static void ksm_calc_checksums(int start, int end)
+{
+	int i;
+
+	for (i = start; i < end; i++)
+		ksm_scan_batch[i].checksum = calc_checksum(ksm_scan_batch[i].page);
+}
+
+static void ksm_checksum_workfn(struct work_struct *work)
+{
+	struct ksm_checksum_work *cw;
+	u64 start = local_clock();
+
+	cw = container_of(work, struct ksm_checksum_work, work);
+	ksm_calc_checksums(cw->start, cw->end);
+	cw->runtime = local_clock() - start;
+}
+
+static void ksm_merge_batch(int nr_items)
+{
+	struct ksm_scan_item *item;
+	int nr_threads = min_t(int, ksm_scan_threads, nr_items);
+	int stride, i;
+
+	if (!nr_items)
+		return;
+
+	stride = DIV_ROUND_UP(nr_items, nr_threads);
+	for (i = 1; i < nr_threads; i++) {
+		struct ksm_checksum_work *cw = &ksm_checksum_work[i];
+
+		cw->start = i * stride;
+		cw->end = min(nr_items, cw->start + stride);
+		queue_work(system_unbound_wq, &cw->work);
+	}
+	ksm_calc_checksums(0, min(nr_items, stride));
+	for (i = 1; i < nr_threads; i++) {
+		flush_work(&ksm_checksum_work[i].work);
+		ksm_scan_cpu_ns += ksm_checksum_work[i].runtime;
+	}
+
+	for (i = 0; i < nr_items; i++) {
+		item = &ksm_scan_batch[i];
+		cmp_and_merge_page(item->page, item->rmap_item, item->checksum);
+		put_page(item->page);
+		cond_resched();
+	}
+}
+
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
@@ -1411,16 +1585,31 @@ static void ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	int nr_items = 0;
 
-	while (scan_npages-- && likely(!freezing(current))) {
+	while (scan_npages && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
+		rmap_item = scan_get_next_rmap_item(&page, nr_items > 0);
+		if (IS_ERR(rmap_item)) {
+			ksm_merge_batch(nr_items);
+			nr_items = 0;
+			continue;
+		}
 		if (!rmap_item)
-			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+			break;
+		scan_npages--;
+		if (PageKsm(page) && in_stable_tree(rmap_item)) {
+			put_page(page);
+			continue;
+		}
+		ksm_scan_batch[nr_items].page = page;
+		ksm_scan_batch[nr_items].rmap_item = rmap_item;
+		if (++nr_items == KSM_SCAN_BATCH) {
+			ksm_merge_batch(nr_items);
+			nr_items = 0;
+		}
 	}
+	ksm_merge_batch(nr_items);
 }
 
 static int ksmd_should_run(void)
@@ -1435,8 +1624,12 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			u64 runtime = task_sched_runtime(current);
+
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_scan_cpu_ns += task_sched_runtime(current) - runtime;
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1872,6 +2065,31 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t scan_threads_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_scan_threads);
+}
+
+static ssize_t scan_threads_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_threads;
+
+	err = strict_strtoul(buf, 10, &nr_threads);
+	if (err || !nr_threads || nr_threads > KSM_MAX_SCAN_THREADS)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	ksm_scan_threads = nr_threads;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(scan_threads);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1967,6 +2185,35 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t scan_cpu_msecs_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", div_u64(ksm_scan_cpu_ns, NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(scan_cpu_msecs);
+
+static ssize_t merge_rate_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	u64 cpu_ns, rate = 0;
+
+	mutex_lock(&ksm_thread_mutex);
+	cpu_ns = ksm_scan_cpu_ns;
+	if (cpu_ns)
+		rate = div64_u64((u64)ksm_pages_merged * NSEC_PER_SEC, cpu_ns);
+	mutex_unlock(&ksm_thread_mutex);
+
+	return sprintf(buf, "%llu\n", rate);
+}
+KSM_ATTR_RO(merge_rate);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1976,6 +2223,10 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&scan_threads_attr.attr,
+	&pages_merged_attr.attr,
+	&scan_cpu_msecs_attr.attr,
+	&merge_rate_attr.attr,
 	NULL,
 };
 
@@ -1988,12 +2239,15 @@ static struct attribute_group ksm_attr_group = {
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
-	int err;
+	int err, i;
 
 	err = ksm_slab_init();
 	if (err)
 		goto out;
 
+	for (i = 0; i < KSM_MAX_SCAN_THREADS; i++)
+		INIT_WORK(&ksm_checksum_work[i].work, ksm_checksum_workfn);
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
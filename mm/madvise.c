@@ -110,7 +110,9 @@ success:
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
+	vm_write_begin(vma);
 	vma->vm_flags = new_flags;
+	vm_write_end(vma);
 
 out:
 	if (error == -ENOMEM)
@@ -164,6 +166,13 @@ static long madvise_willneed(struct vm_area_struct * vma,
  * An interface that causes the system to free clean pages and flush
  * dirty pages is already available as msync(MS_INVALIDATE).
  */
+/*
+ * Unlike munmap(), this zaps under mmap_sem rather than under a range lock
+ * of mm->mmap_range: mmap_sem is only held for reading, so page faults and
+ * other madvise(MADV_DONTNEED) callers are not held up.  Zapping after
+ * dropping it would leave the vma unpinned against a concurrent munmap,
+ * vma merge or khugepaged collapse, none of which wait for range locks.
+ */
 static long madvise_dontneed(struct vm_area_struct * vma,
 			     struct vm_area_struct ** prev,
 			     unsigned long start, unsigned long end)
@@ -246,6 +246,8 @@ void shake_page(struct page *p, int access)
 				.gfp_mask = GFP_KERNEL,
 			};
 
+			nodes_clear(shrink.nodes_to_scan);
+			node_set(page_to_nid(p), shrink.nodes_to_scan);
 			nr = shrink_slab(&shrink, 1000, 1000);
 			if (page_count(p) == 1)
 				break;
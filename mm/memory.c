@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1248,8 +1249,14 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next - addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
-				split_huge_page_pmd(vma->vm_mm, pmd);
+				/*
+				 * File pmds are also zapped by truncation and
+				 * unmap_mapping_range(), under i_mmap_mutex
+				 * rather than mmap_sem.
+				 */
+				VM_BUG_ON(!vma->vm_file &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
+				split_huge_page_pmd(vma, addr, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd, addr))
 				goto next;
 			/* fall through */
@@ -1491,8 +1498,11 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 		goto out;
 	}
 	if (pmd_trans_huge(*pmd)) {
-		if (flags & FOLL_SPLIT) {
-			split_huge_page_pmd(mm, pmd);
+		/* file pages are only mlocked when mapped by ptes */
+		if ((flags & FOLL_SPLIT) ||
+		    (vma->vm_ops && (flags & FOLL_MLOCK) &&
+		     (vma->vm_flags & VM_LOCKED))) {
+			split_huge_page_pmd(vma, address, pmd);
 			goto split_fallthrough;
 		}
 		spin_lock(&mm->page_table_lock);
@@ -3356,14 +3366,114 @@ uncharge_out:
 	return ret;
 }
 
+/**
+ * do_set_pte - setup a read-only pte for a page cache page
+ * @vma: virtual memory area
+ * @address: user virtual address
+ * @page: page to map, locked and with a reference held by the caller
+ * @pte: pointer to target page table entry
+ *
+ * Used by ->map_pages() implementations; the caller holds the page
+ * table lock and has checked that the pte is none.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * Number of pages around a read fault which are mapped from the page
+ * cache, if already cached and uptodate, under the same page table
+ * lock.  Zero or one disables fault-around.  Rounded down to a power
+ * of two and never crosses a page table boundary.
+ */
+int sysctl_fault_around_pages __read_mostly;
+
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long start_addr, nr_pages, mask;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off, mapped;
+
+	nr_pages = rounddown_pow_of_two(min_t(unsigned long,
+				ACCESS_ONCE(sysctl_fault_around_pages),
+				PTRS_PER_PTE));
+	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
+
+	start_addr = max(address & mask, vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/*
+	 * max_pgoff is either end of page table or end of vma or
+	 * nr_pages from pgoff, depending on what is nearest.
+	 */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			pgoff + nr_pages - 1);
+
+	/* Skip leading populated ptes: nothing to do if all are present */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *) start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vmf.page = NULL;
+	mapped = vma->vm_ops->map_pages(vma, &vmf);
+	if (mapped)
+		add_mm_counter(vma->vm_mm, MM_FAULTAROUND, mapped);
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		unsigned int flags, pte_t orig_pte)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	spinlock_t *ptl;
 
 	pte_unmap(page_table);
+
+	/*
+	 * Let's call ->map_pages() first and use ->fault() as fallback
+	 * if the page by the offset is not ready to be mapped (cold cache
+	 * or something).
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    sysctl_fault_around_pages > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		if (likely(pte_same(*page_table, orig_pte)))
+			do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
@@ -3399,6 +3509,60 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+/*
+ * A NUMA hinting fault: the pte was made inaccessible by the scanner in
+ * task_numa_work().  Make it accessible again, tell the scheduler which
+ * node the page is on, and move the page if it is on the wrong node.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long addr, pte_t pte, pte_t *ptep, pmd_t *pmd)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	int page_nid, target_nid;
+	int migrated = 0;
+
+	/*
+	 * The pte was read without the lock: check it is still the one
+	 * we faulted on before using it.
+	 */
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*ptep, pte))) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+
+	pte = pte_mknonnuma(pte);
+	set_pte_at(mm, addr, ptep, pte);
+	update_mmu_cache(vma, addr, ptep);
+
+	page = vm_normal_page(vma, addr, pte);
+	if (!page) {
+		pte_unmap_unlock(ptep, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(ptep, ptl);
+
+	page_nid = page_to_nid(page);
+	count_vm_numa_event(NUMA_HINT_FAULTS);
+	if (page_nid == numa_node_id())
+		count_vm_numa_event(NUMA_HINT_FAULTS_LOCAL);
+
+	target_nid = mpol_misplaced(page, vma, addr);
+	if (target_nid == -1) {
+		put_page(page);
+	} else {
+		migrated = migrate_misplaced_page(page, target_nid);
+		if (migrated)
+			page_nid = target_nid;
+	}
+
+	task_numa_fault(page_nid, 1, migrated);
+	return 0;
+}
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3437,6 +3601,14 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+	/*
+	 * PROT_NONE ptes look just like NUMA hinting ones, but they are
+	 * only reached here by get_user_pages(): leave those alone.
+	 */
+	if (pte_numa(entry) &&
+	    (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		return do_numa_page(mm, vma, address, entry, pte, pmd);
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3498,16 +3670,25 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		if (!vma->vm_ops)
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
+		if (vma->vm_ops->pmd_fault) {
+			int ret = vma->vm_ops->pmd_fault(vma, address, pmd,
+							 flags);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
 	} else {
 		pmd_t orig_pmd = *pmd;
 		barrier();
 		if (pmd_trans_huge(orig_pmd)) {
-			if (flags & FAULT_FLAG_WRITE &&
-			    !pmd_write(orig_pmd) &&
-			    !pmd_trans_splitting(orig_pmd))
+			if (!(flags & FAULT_FLAG_WRITE) ||
+			    pmd_write(orig_pmd) ||
+			    pmd_trans_splitting(orig_pmd))
+				return 0;
+			if (!vma->vm_ops)
 				return do_huge_pmd_wp_page(mm, vma, address,
 							   pmd, orig_pmd);
-			return 0;
+			/* write to a file huge pmd: fault in the pte */
+			split_huge_page_pmd(vma, address, pmd);
 		}
 	}
 
@@ -3532,6 +3713,156 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Handle a fault on an anonymous private mapping without mmap_sem.
+ *
+ * The vma is found under RCU and pinned by its refcount, and
+ * vm_sequence is sampled before looking at it.  The page tables are
+ * walked with interrupts off, which holds off the TLB flush IPI that
+ * precedes freeing them, just as in get_user_pages_fast(); the pte
+ * lock is only trylocked there, since its holder might be waiting for
+ * that IPI.  Once the pte lock is held and vm_sequence has not moved,
+ * any munmap, mprotect or merge of the vma has either not started or
+ * must still take this pte lock, so the pte can be set as usual.
+ *
+ * Only the common first touch of an already populated page table is
+ * handled here: anything else returns VM_FAULT_RETRY and the caller
+ * takes mmap_sem and goes through handle_mm_fault().
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned long vm_flags;
+	pgprot_t vm_page_prot;
+	unsigned int seq;
+	spinlock_t *ptl;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	int ret = VM_FAULT_RETRY;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		goto out;
+
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	if (seq & 1)
+		goto out_put;
+	smp_rmb();
+	/* unmapped or merged away before seq was read */
+	if (RB_EMPTY_NODE(&vma->vm_rb))
+		goto out_put;
+
+	vm_flags = vma->vm_flags;
+	vm_page_prot = vma->vm_page_prot;
+	if (vma->vm_ops || !vma->anon_vma || vma_policy(vma))
+		goto out_put;
+	if (vm_flags & (VM_SHARED | VM_LOCKED | VM_GROWSDOWN | VM_GROWSUP |
+			VM_PFNMAP | VM_MIXEDMAP | VM_HUGETLB))
+		goto out_put;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_put;
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out_put;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		/* vm_policy was NULL: the task policy applies */
+		page = alloc_zeroed_user_highpage_movable(NULL, address);
+		if (!page)
+			goto out_put;
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			goto out_put;
+		}
+	}
+
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out_walk;
+
+	ptl = pte_lockptr(mm, &pmdval);
+	pte = pte_offset_map(&pmdval, address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out_walk;
+	}
+	if (!pmd_same(*pmd, pmdval) ||
+	    read_seqcount_retry(&vma->vm_sequence, seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out_walk;
+	}
+	local_irq_enable();
+
+	entry = *pte;
+	if (!pte_none(entry)) {
+		/*
+		 * Raced with another fault: fine unless this needs COW, or
+		 * is a NUMA hinting fault
+		 */
+		if (pte_present(entry) && !pte_numa(entry) &&
+		    (!(flags & FAULT_FLAG_WRITE) || pte_write(entry)))
+			ret = 0;
+		goto out_unlock;
+	}
+
+	if (flags & FAULT_FLAG_WRITE) {
+		entry = pte_mkwrite(pte_mkdirty(mk_pte(page, vm_page_prot)));
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+		page = NULL;
+	} else
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vm_page_prot));
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	ret = 0;
+
+out_unlock:
+	pte_unmap_unlock(pte, ptl);
+	goto out_free;
+out_walk:
+	local_irq_enable();
+out_free:
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+out_put:
+	put_vma(vma);
+out:
+	if (ret == VM_FAULT_RETRY) {
+		count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+		return ret;
+	}
+	__set_current_state(TASK_RUNNING);
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	check_sync_rss_stat(current);
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -90,6 +90,7 @@
 #include <linux/syscalls.h>
 #include <linux/ctype.h>
 #include <linux/mm_inline.h>
+#include <linux/mmu_notifier.h>
 
 #include <asm/tlbflush.h>
 #include <asm/uaccess.h>
@@ -511,7 +512,7 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		split_huge_page_pmd(vma->vm_mm, pmd);
+		split_huge_page_pmd(vma, addr, pmd);
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
@@ -608,6 +609,41 @@ check_range(struct mm_struct *mm, unsigned long start, unsigned long end,
 }
 
 /* Step 2: apply policy to a range and do splits. */
+/*
+ * Apply policy to a single VMA.  If this is a shared policy then
+ * ->set_policy will increment the reference count for an sp node.
+ * Speculative page faults do not look at vmas with a policy, so
+ * installing one is bracketed by vm_sequence like any other vma change.
+ */
+static int vma_replace_policy(struct vm_area_struct *vma,
+			      struct mempolicy *pol)
+{
+	struct mempolicy *old, *new;
+	int err = 0;
+
+	pr_debug("vma %lx-%lx/%lx vm_ops %p vm_file %p set_policy %p\n",
+		 vma->vm_start, vma->vm_end, vma->vm_pgoff,
+		 vma->vm_ops, vma->vm_file,
+		 vma->vm_ops ? vma->vm_ops->set_policy : NULL);
+
+	new = mpol_dup(pol);
+	if (IS_ERR(new))
+		return PTR_ERR(new);
+
+	vm_write_begin(vma);
+	if (vma->vm_ops && vma->vm_ops->set_policy)
+		err = vma->vm_ops->set_policy(vma, new);
+	if (!err) {
+		old = vma->vm_policy;
+		vma->vm_policy = new;	/* protected by mmap_sem */
+		new = old;
+	}
+	vm_write_end(vma);
+	mpol_put(new);
+
+	return err;
+}
+
 static int mbind_range(struct mm_struct *mm, unsigned long start,
 		       unsigned long end, struct mempolicy *new_pol)
 {
@@ -656,22 +692,9 @@ static int mbind_range(struct mm_struct *mm, unsigned long start,
 				goto out;
 		}
 
-		/*
-		 * Apply policy to a single VMA. The reference counting of
-		 * policy for vma_policy linkages has already been handled by
-		 * vma_merge and split_vma as necessary. If this is a shared
-		 * policy then ->set_policy will increment the reference count
-		 * for an sp node.
-		 */
-		pr_debug("vma %lx-%lx/%lx vm_ops %p vm_file %p set_policy %p\n",
-			vma->vm_start, vma->vm_end, vma->vm_pgoff,
-			vma->vm_ops, vma->vm_file,
-			vma->vm_ops ? vma->vm_ops->set_policy : NULL);
-		if (vma->vm_ops && vma->vm_ops->set_policy) {
-			err = vma->vm_ops->set_policy(vma, new_pol);
-			if (err)
-				goto out;
-		}
+		err = vma_replace_policy(vma, new_pol);
+		if (err)
+			goto out;
 	}
 
  out:
@@ -1650,6 +1673,88 @@ static inline unsigned interleave_nid(struct mempolicy *pol,
 		return interleave_nodes(pol);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * change_prot_numa(@vma, @addr, @end)
+ *
+ * Turn the ptes of [@addr, @end) into NUMA hinting ptes, so that the next
+ * access to each page takes a fault that tells which node it came from.
+ * Returns the number of ptes updated.  mmap_sem must be held.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end)
+{
+	unsigned long nr_updated;
+
+	mmu_notifier_invalidate_range_start(vma->vm_mm, addr, end);
+	nr_updated = change_protection(vma, addr, end, vma->vm_page_prot,
+				       0, 1);
+	mmu_notifier_invalidate_range_end(vma->vm_mm, addr, end);
+	if (nr_updated)
+		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
+
+	return nr_updated;
+}
+
+/*
+ * mpol_misplaced(@page, @vma, @addr)
+ *
+ * Called from a NUMA hinting fault on @page, mapped at @addr in @vma.
+ * Returns the node @page should be migrated to, or -1 if it is fine
+ * where it is.  Explicit policies are honoured: only under the default
+ * local policy does a page follow the node of the task accessing it.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	struct zone *zone;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int polnid = -1;
+	int ret = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+
+	switch (pol->mode) {
+	case MPOL_INTERLEAVE:
+		polnid = interleave_nid(pol, vma, addr, PAGE_SHIFT);
+		break;
+
+	case MPOL_PREFERRED:
+		if (pol->flags & MPOL_F_LOCAL)
+			polnid = thisnid;
+		else
+			polnid = pol->v.preferred_node;
+		break;
+
+	case MPOL_BIND:
+		/*
+		 * Any node of the mask will do: only move pages that are
+		 * outside of it, to the first node of the mask in the
+		 * local zonelist.
+		 */
+		if (node_isset(curnid, pol->v.nodes))
+			goto out;
+		(void)first_zones_zonelist(
+				node_zonelist(thisnid, GFP_HIGHUSER),
+				gfp_zone(GFP_HIGHUSER),
+				&pol->v.nodes, &zone);
+		if (zone)
+			polnid = zone->node;
+		break;
+
+	default:
+		BUG();
+	}
+	if (polnid != -1 && curnid != polnid)
+		ret = polnid;
+out:
+	mpol_cond_put(pol);
+	return ret;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Return the bit number of a random bit set in the nodemask.
  * (returns -1 if nodemask is empty)
@@ -1424,3 +1424,80 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Does the node have nr_pages free above the high watermark of one of
+ * its zones?  Pages found misplaced are fine where they are if the
+ * node they belong on is short of memory.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   int nr_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone) || zone->all_unreclaimable)
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				      high_wmark_pages(zone) + nr_pages, 0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data, int **result)
+{
+	int nid = (int) data;
+
+	return alloc_pages_exact_node(nid,
+				      (GFP_HIGHUSER_MOVABLE | GFP_THISNODE |
+				       __GFP_NOMEMALLOC | __GFP_NORETRY |
+				       __GFP_NOWARN) & ~GFP_IOFS, 0);
+}
+
+/*
+ * Migrate a page found misplaced by a NUMA hinting fault to @node.  The
+ * caller's reference on the page is dropped.  Returns 1 if the page was
+ * migrated, 0 otherwise.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	/*
+	 * Pages mapped by several processes would only bounce between the
+	 * nodes of their users, so leave them alone.
+	 */
+	if (page_mapcount(page) != 1 || PageKsm(page) || PageTransHuge(page))
+		goto out;
+
+	if (!migrate_balanced_pgdat(NODE_DATA(node), 1))
+		goto out;
+
+	if (isolate_lru_page(page))
+		goto out;
+
+	list_add(&page->lru, &migratepages);
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	/* the isolation holds its own reference */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, MIGRATE_ASYNC);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_numa_event(NUMA_PAGE_MIGRATE);
+	return 1;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
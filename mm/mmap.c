@@ -49,6 +49,9 @@
 static void unmap_region(struct mm_struct *mm,
 		struct vm_area_struct *vma, struct vm_area_struct *prev,
 		unsigned long start, unsigned long end);
+static void __unmap_region(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long floor, unsigned long ceiling,
+		unsigned long start, unsigned long end);
 
 /*
  * WARNING: the debugging will use recursive algorithms so never enable this
@@ -220,6 +223,91 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/* mm_rb writers are serialised by mmap_sem held for writing */
+static inline void mm_rb_write_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mm_rb_seq);
+}
+
+static inline void mm_rb_write_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mm_rb_seq);
+}
+
+/*
+ * Look up the vma containing addr without mmap_sem, for a speculative
+ * page fault.  mm_rb is walked under RCU, which keeps vmas erased meanwhile
+ * from being freed (see put_vma()), and mm_rb_seq tells whether the tree
+ * changed under us; a rebalance can send the walk anywhere, so it is
+ * checked at every step.  The vma is returned with a reference held,
+ * which keeps the structure (but nothing it points to) from being freed;
+ * the caller must check vm_sequence before trusting its contents.
+ */
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	struct rb_node *rb_node;
+	unsigned int seq;
+
+	rcu_read_lock();
+again:
+	vma = NULL;
+	seq = read_seqcount_begin(&mm->mm_rb_seq);
+	rb_node = rcu_dereference(mm->mm_rb.rb_node);
+	while (rb_node) {
+		struct vm_area_struct *vma_tmp;
+
+		if (read_seqcount_retry(&mm->mm_rb_seq, seq))
+			goto again;
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (vma_tmp->vm_end > addr) {
+			vma = vma_tmp;
+			if (vma_tmp->vm_start <= addr)
+				break;
+			rb_node = rcu_dereference(rb_node->rb_left);
+		} else
+			rb_node = rcu_dereference(rb_node->rb_right);
+	}
+	if (read_seqcount_retry(&mm->mm_rb_seq, seq))
+		goto again;
+	/* A vma whose last reference is gone is being erased: let it go */
+	if (!vma || vma->vm_start > addr ||
+	    !atomic_inc_not_zero(&vma->vm_ref_count))
+		vma = NULL;
+	rcu_read_unlock();
+
+	return vma;
+}
+
+static void __free_vma(struct rcu_head *head)
+{
+	struct vm_area_struct *vma;
+
+	vma = container_of(head, struct vm_area_struct, vm_rcu_head);
+	kmem_cache_free(vm_area_cachep, vma);
+}
+
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_and_test(&vma->vm_ref_count))
+		call_rcu(&vma->vm_rcu_head, __free_vma);
+}
+#else
+static inline void mm_rb_write_begin(struct mm_struct *mm)
+{
+}
+
+static inline void mm_rb_write_end(struct mm_struct *mm)
+{
+}
+
+static inline void put_vma(struct vm_area_struct *vma)
+{
+	kmem_cache_free(vm_area_cachep, vma);
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -236,7 +324,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 			removed_exe_file_vma(vma->vm_mm);
 	}
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -393,8 +481,15 @@ find_vma_prepare(struct mm_struct *mm, unsigned long addr,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/* mm_rb holds the initial reference, dropped by put_vma() */
+	seqcount_init(&vma->vm_sequence);
+	atomic_set(&vma->vm_ref_count, 1);
+#endif
+	mm_rb_write_begin(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_end(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -475,7 +570,11 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_begin(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_end(mm);
+	/* Tells speculative faults still holding vma that it is gone */
+	RB_CLEAR_NODE(&vma->vm_rb);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -579,6 +678,15 @@ again:			remove_next = 1 + (end > next->vm_end);
 			vma_prio_tree_remove(next, root);
 	}
 
+	/*
+	 * A removed next is unlinked inside its write section, so that
+	 * speculative faults still holding it see it change, or see it
+	 * unlinked if they only look at it afterwards.
+	 */
+	vm_write_begin(vma);
+	if (adjust_next || remove_next)
+		vm_write_begin(next);
+
 	vma->vm_start = start;
 	vma->vm_end = end;
 	vma->vm_pgoff = pgoff;
@@ -611,6 +719,10 @@ again:			remove_next = 1 + (end > next->vm_end);
 		__insert_vm_struct(mm, insert);
 	}
 
+	if (adjust_next || remove_next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	if (anon_vma)
 		anon_vma_unlock(anon_vma);
 	if (mapping)
@@ -626,7 +738,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -1240,6 +1352,9 @@ munmap_back:
 		vm_flags |= VM_ACCOUNT;
 	}
 
+	/* An unlocked munmap may still be freeing page tables here */
+	range_wait_unlocked(&mm->mmap_range, addr, addr + len);
+
 	/*
 	 * Can we just expand an old mapping?
 	 */
@@ -1698,6 +1813,8 @@ int expand_upwards(struct vm_area_struct *vma, unsigned long address)
 	 */
 	if (unlikely(anon_vma_prepare(vma)))
 		return -ENOMEM;
+	range_wait_unlocked(&vma->vm_mm->mmap_range, vma->vm_end,
+			    PAGE_ALIGN(address + 4));
 	vma_lock_anon_vma(vma);
 
 	/*
@@ -1725,7 +1842,9 @@ int expand_upwards(struct vm_area_struct *vma, unsigned long address)
 		if (vma->vm_pgoff + (size >> PAGE_SHIFT) >= vma->vm_pgoff) {
 			error = acct_stack_growth(vma, size, grow);
 			if (!error) {
+				vm_write_begin(vma);
 				vma->vm_end = address;
+				vm_write_end(vma);
 				perf_event_mmap(vma);
 			}
 		}
@@ -1756,6 +1875,7 @@ int expand_downwards(struct vm_area_struct *vma,
 	if (error)
 		return error;
 
+	range_wait_unlocked(&vma->vm_mm->mmap_range, address, vma->vm_start);
 	vma_lock_anon_vma(vma);
 
 	/*
@@ -1775,8 +1895,10 @@ int expand_downwards(struct vm_area_struct *vma,
 		if (grow <= vma->vm_pgoff) {
 			error = acct_stack_growth(vma, size, grow);
 			if (!error) {
+				vm_write_begin(vma);
 				vma->vm_start = address;
 				vma->vm_pgoff -= grow;
+				vm_write_end(vma);
 				perf_event_mmap(vma);
 			}
 		}
@@ -1840,11 +1962,12 @@ find_extend_vma(struct mm_struct * mm, unsigned long addr)
 
 /*
  * Ok - we have the memory areas we should free on the vma list,
- * so release them, and do the vma updates.
+ * so do the vma updates before releasing them.
  *
  * Called with the mm semaphore held.
  */
-static void remove_vma_list(struct mm_struct *mm, struct vm_area_struct *vma)
+static void unaccount_vma_list(struct mm_struct *mm,
+			       struct vm_area_struct *vma)
 {
 	/* Update high watermark before we lower total_vm */
 	update_hiwater_vm(mm);
@@ -1853,7 +1976,7 @@ static void remove_vma_list(struct mm_struct *mm, struct vm_area_struct *vma)
 
 		mm->total_vm -= nrpages;
 		vm_stat_account(mm, vma->vm_flags, vma->vm_file, -nrpages);
-		vma = remove_vma(vma);
+		vma = vma->vm_next;
 	} while (vma);
 	validate_mm(mm);
 }
@@ -1868,6 +1991,20 @@ static void unmap_region(struct mm_struct *mm,
 		unsigned long start, unsigned long end)
 {
 	struct vm_area_struct *next = prev? prev->vm_next: mm->mmap;
+
+	__unmap_region(mm, vma, prev ? prev->vm_end : FIRST_USER_ADDRESS,
+		       next ? next->vm_start : 0, start, end);
+}
+
+/*
+ * Page tables are freed between floor and ceiling (0 meaning the top of
+ * the address space), so that range must not gain new mappings meanwhile.
+ * That is either by holding mmap_sem, or by holding it in mm->mmap_range.
+ */
+static void __unmap_region(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long floor, unsigned long ceiling,
+		unsigned long start, unsigned long end)
+{
 	struct mmu_gather tlb;
 	unsigned long nr_accounted = 0;
 
@@ -1876,11 +2013,27 @@ static void unmap_region(struct mm_struct *mm,
 	update_hiwater_rss(mm);
 	unmap_vmas(&tlb, vma, start, end, &nr_accounted, NULL);
 	vm_unacct_memory(nr_accounted);
-	free_pgtables(&tlb, vma, prev ? prev->vm_end : FIRST_USER_ADDRESS,
-				 next ? next->vm_start : 0);
+	free_pgtables(&tlb, vma, floor, ceiling);
 	tlb_finish_mmu(&tlb, start, end);
 }
 
+/*
+ * Can this list of detached vmas be unmapped after dropping mmap_sem?
+ * Only plain private anonymous memory: the teardown of file, special
+ * and hugetlb mappings may rely on mmap_sem being held.
+ */
+static int can_unmap_unlocked(struct vm_area_struct *vma)
+{
+	for (; vma; vma = vma->vm_next) {
+		if (vma->vm_file || vma->vm_ops)
+			return 0;
+		if (vma->vm_flags & (VM_HUGETLB | VM_LOCKED | VM_PFNMAP |
+				     VM_MIXEDMAP | VM_NONLINEAR))
+			return 0;
+	}
+	return 1;
+}
+
 /*
  * Create a list of vma's touched by the unmap, removing them from the mm's
  * vma list as we go..
@@ -1895,12 +2048,18 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+	mm_rb_write_begin(mm);
 	do {
+		/* Speculative faults holding vma see it change, or unlinked */
+		vm_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
+		RB_CLEAR_NODE(&vma->vm_rb);
+		vm_write_end(vma);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+	mm_rb_write_end(mm);
 	*insertion_point = vma;
 	if (vma)
 		vma->vm_prev = prev;
@@ -2008,10 +2167,19 @@ int split_vma(struct mm_struct *mm, struct vm_area_struct *vma,
  * work.  This now handles partial unmappings.
  * Jeremy Fitzhardinge <jeremy@goop.org>
  */
-int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
+/*
+ * With unlock set, and if only private anonymous memory is unmapped,
+ * mmap_sem is released once the vmas are detached and 1 is returned:
+ * the pages and page tables are then freed under a range lock covering
+ * the hole left behind, so faults, madvise and other munmaps elsewhere
+ * in the address space do not wait for them.
+ */
+static int __do_munmap(struct mm_struct *mm, unsigned long start, size_t len,
+		       bool unlock)
 {
-	unsigned long end;
-	struct vm_area_struct *vma, *prev, *last;
+	unsigned long end, floor, ceiling;
+	struct vm_area_struct *vma, *prev, *last, *next;
+	struct range_lock range;
 
 	if ((start & ~PAGE_MASK) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -2082,14 +2250,38 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	 * Remove the vma's, and unmap the actual pages
 	 */
 	detach_vmas_to_be_unmapped(mm, vma, prev, end);
-	unmap_region(mm, vma, prev, start, end);
+
+	/*
+	 * Wait for any unlocked unmap which may still be freeing page
+	 * tables in the hole we are about to free into.
+	 */
+	next = prev ? prev->vm_next : mm->mmap;
+	floor = prev ? prev->vm_end : FIRST_USER_ADDRESS;
+	ceiling = next ? next->vm_start : 0;
+	range_lock_init(&range, floor, ceiling ? ceiling : ULONG_MAX);
+	range_lock(&mm->mmap_range, &range);
 
 	/* Fix up all other VM information */
-	remove_vma_list(mm, vma);
+	unaccount_vma_list(mm, vma);
+	if (unlock && can_unmap_unlocked(vma))
+		up_write(&mm->mmap_sem);
+	else
+		unlock = false;
 
-	return 0;
+	__unmap_region(mm, vma, floor, ceiling, start, end);
+	range_unlock(&mm->mmap_range, &range);
+
+	do {
+		vma = remove_vma(vma);
+	} while (vma);
+
+	return unlock;
 }
 
+int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
+{
+	return __do_munmap(mm, start, len, false);
+}
 EXPORT_SYMBOL(do_munmap);
 
 SYSCALL_DEFINE2(munmap, unsigned long, addr, size_t, len)
@@ -2100,7 +2292,10 @@ SYSCALL_DEFINE2(munmap, unsigned long, addr, size_t, len)
 	profile_munmap(addr);
 
 	down_write(&mm->mmap_sem);
-	ret = do_munmap(mm, addr, len);
+	ret = __do_munmap(mm, addr, len, true);
+	/* __do_munmap() returns 1 once it has dropped mmap_sem */
+	if (ret == 1)
+		return 0;
 	up_write(&mm->mmap_sem);
 	return ret;
 }
@@ -2183,6 +2378,8 @@ unsigned long do_brk(unsigned long addr, unsigned long len)
 	if (security_vm_enough_memory(len >> PAGE_SHIFT))
 		return -ENOMEM;
 
+	range_wait_unlocked(&mm->mmap_range, addr, addr + len);
+
 	/* Can we just expand an old private anonymous mapping? */
 	vma = vma_merge(mm, prev, addr, addr + len, flags,
 					NULL, NULL, pgoff, NULL);
@@ -2293,6 +2490,7 @@ int insert_vm_struct(struct mm_struct * mm, struct vm_area_struct * vma)
 	__vma = find_vma_prepare(mm,vma->vm_start,&prev,&rb_link,&rb_parent);
 	if (__vma && __vma->vm_start < vma->vm_end)
 		return -ENOMEM;
+	range_wait_unlocked(&mm->mmap_range, vma->vm_start, vma->vm_end);
 	if ((vma->vm_flags & VM_ACCOUNT) &&
 	     security_vm_enough_memory_mm(mm, vma_pages(vma)))
 		return -ENOMEM;
@@ -2325,6 +2523,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 	}
 
 	find_vma_prepare(mm, addr, &prev, &rb_link, &rb_parent);
+	range_wait_unlocked(&mm->mmap_range, addr, addr + len);
 	new_vma = vma_merge(mm, prev, addr, addr + len, vma->vm_flags,
 			vma->anon_vma, vma->vm_file, pgoff, vma_policy(vma));
 	if (new_vma) {
@@ -110,14 +110,26 @@ unsigned long __init free_low_memory_core_early(int nodeid)
 	unsigned long count = 0;
 	phys_addr_t start, end;
 	u64 i;
+	int nid;
 
-	/* free reserved array temporarily so that it's treated as free area */
-	memblock_free_reserved_regions();
+	init_deferred_reserved_pages();
 
-	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, NULL) {
+	/*
+	 * free reserved array temporarily so that it's treated as free area,
+	 * unless the pgdatinit kthreads are going to walk it after us: then
+	 * free_memblock_reserved_array() frees it once they are done
+	 */
+	if (!IS_ENABLED(CONFIG_DEFERRED_STRUCT_PAGE_INIT))
+		memblock_free_reserved_regions();
+
+	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, &nid) {
 		unsigned long start_pfn = PFN_UP(start);
 		unsigned long end_pfn = min_t(unsigned long,
 					      PFN_DOWN(end), max_low_pfn);
+
+		/* the deferred part of a node is freed by its init kthread */
+		if (nid < MAX_NUMNODES)
+			end_pfn = min(end_pfn, node_first_deferred_pfn(nid));
 		if (start_pfn < end_pfn) {
 			__free_pages_memory(start_pfn, end_pfn);
 			count += end_pfn - start_pfn;
@@ -125,10 +137,37 @@ unsigned long __init free_low_memory_core_early(int nodeid)
 	}
 
 	/* put region array back? */
-	memblock_reserve_reserved_regions();
+	if (!IS_ENABLED(CONFIG_DEFERRED_STRUCT_PAGE_INIT))
+		memblock_reserve_reserved_regions();
 	return count;
 }
 
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/*
+ * Give the pages of memblock.reserved's array to the buddy allocator, once
+ * nothing walks memblock any more.  It was only reallocated if it outgrew
+ * the static array; pages it shares with neighbouring reservations stay.
+ */
+unsigned long __init free_memblock_reserved_array(void)
+{
+	phys_addr_t start, end;
+	unsigned long start_pfn, end_pfn;
+
+	if (memblock.reserved.max <= INIT_MEMBLOCK_REGIONS)
+		return 0;
+
+	start = __pa(memblock.reserved.regions);
+	end = start + sizeof(struct memblock_region) * memblock.reserved.max;
+	start_pfn = PFN_UP(start);
+	end_pfn = PFN_DOWN(end);
+	if (start_pfn >= end_pfn)
+		return 0;
+
+	__free_pages_memory(start_pfn, end_pfn);
+	return end_pfn - start_pfn;
+}
+#endif
+
 /**
  * free_all_bootmem_node - release a node's free pages to the buddy allocator
  * @pgdat: node to be released
@@ -137,6 +176,8 @@ unsigned long __init free_low_memory_core_early(int nodeid)
  */
 unsigned long __init free_all_bootmem_node(pg_data_t *pgdat)
 {
+	/* struct pages must be set up before hotplug info is stored in them */
+	init_deferred_reserved_pages();
 	register_page_bootmem_info_node(pgdat);
 
 	/* free_low_memory_core_early(MAX_NUMNODES) will be called later */
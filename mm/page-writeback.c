@@ -1944,6 +1944,40 @@ void account_page_dirtied(struct page *page, struct address_space *mapping)
 }
 EXPORT_SYMBOL(account_page_dirtied);
 
+/*
+ * Account a newly dirtied page and set its dirty tag without taking
+ * mapping->tree_lock.  The caller must hold the page lock: that keeps the
+ * page in @mapping and keeps writeback from clearing the tag under us.
+ *
+ * Returns 1 on success, or 0 if the tag could not be set locklessly, in
+ * which case the caller has to do both under the tree_lock as usual.
+ */
+int account_and_tag_page_dirty_locked(struct page *page,
+				struct address_space *mapping)
+{
+	unsigned long flags;
+	int tagged;
+
+	VM_BUG_ON(!PageLocked(page));
+
+	if (page->mapping != mapping)
+		return 0;
+
+	rcu_read_lock();
+	tagged = radix_tree_tag_set_lockless(&mapping->page_tree,
+				page_index(page), PAGECACHE_TAG_DIRTY);
+	rcu_read_unlock();
+	if (!tagged)
+		return 0;
+
+	/* account_page_dirtied() relies on interrupts being disabled */
+	local_irq_save(flags);
+	account_page_dirtied(page, mapping);
+	local_irq_restore(flags);
+	return 1;
+}
+EXPORT_SYMBOL(account_and_tag_page_dirty_locked);
+
 /*
  * Helper function for set_page_writeback family.
  * NOTE: Unlike account_page_dirtied this does not rely on being atomic
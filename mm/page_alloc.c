@@ -56,6 +56,7 @@
 #include <trace/events/kmem.h>
 #include <linux/ftrace_event.h>
 #include <linux/memcontrol.h>
+#include <linux/kthread.h>
 #include <linux/prefetch.h>
 #include <linux/page-debug-flags.h>
 
@@ -335,9 +336,17 @@ out:
  * This usage means that zero-order pages may not be compound.
  */
 
+static void free_hot_cold_pages(struct page *page, unsigned int order,
+				int cold);
+
 static void free_compound_page(struct page *page)
 {
-	__free_pages_ok(page, compound_order(page));
+	unsigned int order = compound_order(page);
+
+	if (order <= PCP_MAX_ORDER)
+		free_hot_cold_pages(page, order, 0);
+	else
+		__free_pages_ok(page, order);
 }
 
 void prep_compound_page(struct page *page, unsigned long order)
@@ -620,8 +629,8 @@ static inline int free_pages_check(struct page *page)
 
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone, and of the list's order.
+ * count is the number of base pages to free; pcp->count is updated.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -632,17 +641,19 @@ static inline int free_pages_check(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	int pindex = 0;
 	int batch_free = 0;
 	int to_free = count;
+	int freed = 0;
 
 	spin_lock(&zone->lock);
 	zone->all_unreclaimable = 0;
 	zone->pages_scanned = 0;
 
-	while (to_free) {
+	while (to_free > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -653,25 +664,29 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = to_free;
 
+		order = pindex / MIGRATE_PCPTYPES;
 		do {
 			page = list_entry(list->prev, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
 			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
-		} while (--to_free && --batch_free && !list_empty(list));
+			__free_one_page(page, zone, order, page_private(page));
+			trace_mm_page_pcpu_drain(page, order, page_private(page));
+			to_free -= 1 << order;
+			freed += 1 << order;
+		} while (to_free > 0 && --batch_free && !list_empty(list));
 	}
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
+	pcp->count -= freed;
+	__mod_zone_page_state(zone, NR_FREE_PAGES, freed);
 	spin_unlock(&zone->lock);
 }
 
@@ -1119,7 +1134,6 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	else
 		to_drain = pcp->count;
 	free_pcppages_bulk(zone, to_drain, pcp);
-	pcp->count -= to_drain;
 	local_irq_restore(flags);
 }
 #endif
@@ -1144,10 +1158,8 @@ static void drain_pages(unsigned int cpu)
 		pset = per_cpu_ptr(zone->pageset, cpu);
 
 		pcp = &pset->pcp;
-		if (pcp->count) {
+		if (pcp->count)
 			free_pcppages_bulk(zone, pcp->count, pcp);
-			pcp->count = 0;
-		}
 		local_irq_restore(flags);
 	}
 }
@@ -1205,10 +1217,11 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Free a page of order up to PCP_MAX_ORDER to the per-cpu lists
  * cold == 1 ? free a cold page : free a hot page
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void free_hot_cold_pages(struct page *page, unsigned int order,
+				int cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
@@ -1216,15 +1229,24 @@ void free_hot_cold_page(struct page *page, int cold)
 	int migratetype;
 	int wasMlocked = __TestClearPageMlocked(page);
 
-	if (!free_pages_prepare(page, 0))
+	if (!free_pages_prepare(page, order))
 		return;
 
+	/*
+	 * A compound page is only torn down when it is merged back into
+	 * the buddy lists, but it may be handed out again straight from
+	 * the pcp lists, so do that now.
+	 */
+	if (unlikely(PageCompound(page)))
+		if (unlikely(destroy_compound_page(page, order)))
+			return;
+
 	migratetype = get_pageblock_migratetype(page);
 	set_page_private(page, migratetype);
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -1235,7 +1257,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
-			free_one_page(zone, page, 0, migratetype);
+			free_one_page(zone, page, order, migratetype);
 			goto out;
 		}
 		migratetype = MIGRATE_MOVABLE;
@@ -1243,19 +1265,28 @@ void free_hot_cold_page(struct page *page, int cold)
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
 	if (cold)
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
+		list_add_tail(&page->lru,
+			      &pcp->lists[pcp_list_index(migratetype, order)]);
 	else
-		list_add(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
-	if (pcp->count >= pcp->high) {
+		list_add(&page->lru,
+			 &pcp->lists[pcp_list_index(migratetype, order)]);
+	pcp->count += 1 << order;
+	if (pcp->count >= pcp->high)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
-		pcp->count -= pcp->batch;
-	}
 
 out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	free_hot_cold_pages(page, 0, cold);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -1357,17 +1388,19 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	int cold = !!(gfp_flags & __GFP_COLD);
 
 again:
-	if (likely(order == 0)) {
+	if (likely(order <= PCP_MAX_ORDER)) {
 		struct per_cpu_pages *pcp;
 		struct list_head *list;
 
 		local_irq_save(flags);
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
-		list = &pcp->lists[migratetype];
+		list = &pcp->lists[pcp_list_index(migratetype, order)];
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype, cold);
+			/* Refill with about a batch worth of base pages */
+			int batch = max(pcp->batch >> order, 2);
+
+			pcp->count += rmqueue_bulk(zone, order, batch, list,
+					migratetype, cold) << order;
 			if (unlikely(list_empty(list)))
 				goto failed;
 		}
@@ -1378,7 +1411,7 @@ again:
 			page = list_entry(list->next, struct page, lru);
 
 		list_del(&page->lru);
-		pcp->count--;
+		pcp->count -= 1 << order;
 	} else {
 		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
 			/*
@@ -2220,6 +2253,10 @@ restart:
 	if (!(gfp_mask & __GFP_NO_KSWAPD))
 		wake_all_kswapd(order, zonelist, high_zoneidx,
 						zone_idx(preferred_zone));
+	else
+		/* e.g. THP: no reclaim, but have the next ones find pages */
+		wakeup_kcompactd(preferred_zone->zone_pgdat, order,
+				 zone_idx(preferred_zone));
 
 	/*
 	 * OK, we're below the kswapd watermark and have kicked background
@@ -2452,8 +2489,8 @@ EXPORT_SYMBOL(get_zeroed_page);
 void __free_pages(struct page *page, unsigned int order)
 {
 	if (put_page_testzero(page)) {
-		if (order == 0)
-			free_hot_cold_page(page, 0);
+		if (order <= PCP_MAX_ORDER)
+			free_hot_cold_pages(page, order, 0);
 		else
 			__free_pages_ok(page, order);
 	}
@@ -3558,6 +3595,64 @@ static void setup_zone_migrate_reserve(struct zone *zone)
 	}
 }
 
+static void __meminit __init_single_page(struct page *page, unsigned long pfn,
+				unsigned long zone, int nid)
+{
+	set_page_links(page, zone, nid, pfn);
+	mminit_verify_page_links(page, zone, nid, pfn);
+	init_page_count(page);
+	reset_page_mapcount(page);
+	SetPageReserved(page);
+	INIT_LIST_HEAD(&page->lru);
+#ifdef WANT_PAGE_VIRTUAL
+	/* The shift won't overflow because ZONE_NORMAL is below 4G. */
+	if (!is_highmem_idx(zone))
+		set_page_address(page, __va(pfn << PAGE_SHIFT));
+#endif
+}
+
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/* Memory initialised during early boot in the highest zone of each node */
+#define DEFERRED_INIT_STATIC_PAGES	((2UL << 30) >> PAGE_SHIFT)
+
+static inline void reset_deferred_meminit(pg_data_t *pgdat)
+{
+	pgdat->first_deferred_pfn = ULONG_MAX;
+}
+
+/*
+ * Returns false once enough of the node has been initialised for early
+ * boot, recording where the deferred remainder starts.  Only the highest
+ * zone of a node is deferred, so the lower zones are complete for
+ * address-limited allocations.
+ */
+static inline bool update_defer_init(pg_data_t *pgdat, unsigned long pfn,
+				     unsigned long zone_end,
+				     unsigned long *nr_initialised)
+{
+	if (zone_end < pgdat->node_start_pfn + pgdat->node_spanned_pages)
+		return true;
+
+	if (++(*nr_initialised) > DEFERRED_INIT_STATIC_PAGES &&
+	    !(pfn & (MAX_ORDER_NR_PAGES - 1))) {
+		pgdat->first_deferred_pfn = pfn;
+		return false;
+	}
+	return true;
+}
+#else
+static inline void reset_deferred_meminit(pg_data_t *pgdat)
+{
+}
+
+static inline bool update_defer_init(pg_data_t *pgdat, unsigned long pfn,
+				     unsigned long zone_end,
+				     unsigned long *nr_initialised)
+{
+	return true;
+}
+#endif
+
 /*
  * Initially all pages are reserved - free ones are freed
  * up by free_all_bootmem() once the early boot process is
@@ -3566,16 +3661,19 @@ static void setup_zone_migrate_reserve(struct zone *zone)
 void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		unsigned long start_pfn, enum memmap_context context)
 {
-	struct page *page;
+	pg_data_t *pgdat = NODE_DATA(nid);
 	unsigned long end_pfn = start_pfn + size;
+	unsigned long nr_initialised = 0;
 	unsigned long pfn;
 	struct zone *z;
 
 	if (highest_memmap_pfn < end_pfn - 1)
 		highest_memmap_pfn = end_pfn - 1;
 
-	z = &NODE_DATA(nid)->node_zones[zone];
+	z = &pgdat->node_zones[zone];
 	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+		struct page *page;
+
 		/*
 		 * There can be holes in boot-time mem_map[]s
 		 * handed to this function.  They do not
@@ -3586,13 +3684,12 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 				continue;
 			if (!early_pfn_in_nid(pfn, nid))
 				continue;
+			if (!update_defer_init(pgdat, pfn, end_pfn,
+					       &nr_initialised))
+				break;
 		}
 		page = pfn_to_page(pfn);
-		set_page_links(page, zone, nid, pfn);
-		mminit_verify_page_links(page, zone, nid, pfn);
-		init_page_count(page);
-		reset_page_mapcount(page);
-		SetPageReserved(page);
+		__init_single_page(page, pfn, zone, nid);
 		/*
 		 * Mark the block movable so that blocks are reserved for
 		 * movable at startup. This will force kernel allocations
@@ -3611,16 +3708,184 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		    && (pfn < z->zone_start_pfn + z->spanned_pages)
 		    && !(pfn & (pageblock_nr_pages - 1)))
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+}
 
-		INIT_LIST_HEAD(&page->lru);
-#ifdef WANT_PAGE_VIRTUAL
-		/* The shift won't overflow because ZONE_NORMAL is below 4G. */
-		if (!is_highmem_idx(zone))
-			set_page_address(page, __va(pfn << PAGE_SHIFT));
-#endif
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/* The zone holding a node's deferred pages: the highest one */
+static struct zone * __init deferred_zone(pg_data_t *pgdat, unsigned long pfn)
+{
+	struct zone *zone = pgdat->node_zones + MAX_NR_ZONES - 1;
+
+	while (zone > pgdat->node_zones &&
+	       !(zone->zone_start_pfn <= pfn &&
+		 pfn < zone->zone_start_pfn + zone->spanned_pages))
+		zone--;
+	return zone;
+}
+
+/*
+ * Reserved memblock regions in the deferred part of a node hold the
+ * kernel's early allocations, whose struct pages may be looked up long
+ * before the deferred init kthreads run, so initialise them now.  Pages
+ * that are already initialised are left alone, so this can safely be
+ * called more than once.
+ */
+void __init init_deferred_reserved_pages(void)
+{
+	struct memblock_region *reg;
+	int nid;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+		unsigned long first_pfn = pgdat->first_deferred_pfn;
+		unsigned long zone_end;
+		struct zone *zone;
+
+		if (first_pfn == ULONG_MAX)
+			continue;
+		zone = deferred_zone(pgdat, first_pfn);
+		zone_end = zone->zone_start_pfn + zone->spanned_pages;
+
+		for_each_memblock(reserved, reg) {
+			unsigned long pfn = max_t(unsigned long,
+					PFN_DOWN(reg->base), first_pfn);
+			unsigned long end_pfn = min_t(unsigned long,
+					PFN_UP(reg->base + reg->size), zone_end);
+
+			for (; pfn < end_pfn; pfn++) {
+				struct page *page;
+
+				if (!early_pfn_valid(pfn))
+					continue;
+				if (!early_pfn_in_nid(pfn, nid))
+					continue;
+				page = pfn_to_page(pfn);
+				if (!page->flags)
+					__init_single_page(page, pfn,
+							   zone_idx(zone), nid);
+			}
+		}
 	}
 }
 
+static atomic_t pgdat_init_n_undone __initdata;
+static atomic_long_t pgdat_init_freed __initdata;
+static __initdata DECLARE_COMPLETION(pgdat_init_all_done_comp);
+
+static void __init deferred_free_range(unsigned long pfn,
+				       unsigned long end_pfn)
+{
+	while (pfn < end_pfn) {
+		unsigned int order = MAX_ORDER - 1;
+
+		while (order && ((pfn & ((1UL << order) - 1)) ||
+				 pfn + (1UL << order) > end_pfn))
+			order--;
+		__free_pages_bootmem(pfn_to_page(pfn), order);
+		pfn += 1UL << order;
+		cond_resched();
+	}
+}
+
+/* Initialise and free the deferred part of a node, on that node */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	int nid = pgdat->node_id;
+	const struct cpumask *cpumask = cpumask_of_node(nid);
+	unsigned long first_pfn = pgdat->first_deferred_pfn;
+	unsigned long start = jiffies;
+	unsigned long nr_pages = 0;
+	unsigned long pfn, end_pfn;
+	phys_addr_t spa, epa;
+	struct zone *zone;
+	u64 i;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	zone = deferred_zone(pgdat, first_pfn);
+	end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+
+	for (pfn = first_pfn; pfn < end_pfn; pfn++) {
+		struct page *page;
+
+		if (!(pfn & (MAX_ORDER_NR_PAGES - 1)))
+			cond_resched();
+		if (!early_pfn_valid(pfn))
+			continue;
+		if (!early_pfn_in_nid(pfn, nid))
+			continue;
+		page = pfn_to_page(pfn);
+		if (!page->flags)
+			__init_single_page(page, pfn, zone_idx(zone), nid);
+		/* See memmap_init_zone() */
+		if (!(pfn & (pageblock_nr_pages - 1)))
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+
+	for_each_free_mem_range(i, nid, &spa, &epa, NULL) {
+		unsigned long spfn = max_t(unsigned long, PFN_UP(spa),
+					   first_pfn);
+		unsigned long epfn = min_t(unsigned long, PFN_DOWN(epa),
+					   end_pfn);
+
+		if (spfn < epfn) {
+			deferred_free_range(spfn, epfn);
+			nr_pages += epfn - spfn;
+		}
+	}
+
+	atomic_long_add(nr_pages, &pgdat_init_freed);
+	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
+		jiffies_to_msecs(jiffies - start));
+
+	if (atomic_dec_and_test(&pgdat_init_n_undone))
+		complete(&pgdat_init_all_done_comp);
+	return 0;
+}
+
+/*
+ * Bring up the struct pages left uninitialised by free_area_init_core()
+ * with one kthread per node, and wait for them all to finish.  Called
+ * once the scheduler is up on all CPUs, before the initcalls run.
+ */
+void __init page_alloc_init_late(void)
+{
+	unsigned long start = jiffies;
+	int nid;
+
+	/* One reference for ourselves, dropped once all threads run */
+	atomic_set(&pgdat_init_n_undone, 1);
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+		struct task_struct *p;
+
+		if (pgdat->first_deferred_pfn == ULONG_MAX)
+			continue;
+
+		atomic_inc(&pgdat_init_n_undone);
+		p = kthread_create_on_node(deferred_init_memmap, pgdat, nid,
+					   "pgdatinit%d", nid);
+		if (IS_ERR(p))
+			deferred_init_memmap(pgdat);
+		else
+			wake_up_process(p);
+	}
+
+	if (!atomic_dec_and_test(&pgdat_init_n_undone))
+		wait_for_completion(&pgdat_init_all_done_comp);
+
+	/* The threads walked memblock, whose array only goes now */
+	atomic_long_add(free_memblock_reserved_array(), &pgdat_init_freed);
+	totalram_pages += atomic_long_read(&pgdat_init_freed);
+	pr_info("Deferred struct page init: %lu pages in %ums\n",
+		atomic_long_read(&pgdat_init_freed),
+		jiffies_to_msecs(jiffies - start));
+}
+#endif /* CONFIG_DEFERRED_STRUCT_PAGE_INIT */
+
 static void __meminit zone_init_free_lists(struct zone *zone)
 {
 	int order, t;
@@ -3688,7 +3953,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3696,8 +3961,8 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 /*
@@ -4257,6 +4522,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -4381,6 +4649,7 @@ void __paginginit free_area_init_node(int nid, unsigned long *zones_size,
 
 	pgdat->node_id = nid;
 	pgdat->node_start_pfn = node_start_pfn;
+	reset_deferred_meminit(pgdat);
 	calculate_node_totalpages(pgdat, zones_size, zholes_size);
 
 	alloc_node_mem_map(pgdat);
@@ -109,8 +109,10 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
+	struct page *batch[PAGEVEC_SIZE];
 	struct blk_plug plug;
-	unsigned page_idx;
+	unsigned page_idx, nr, i;
+	int added;
 	int ret;
 
 	blk_start_plug(&plug);
@@ -122,14 +124,24 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
-	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
-		struct page *page = list_to_page(pages);
-		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
+	for (page_idx = 0; page_idx < nr_pages; page_idx += nr) {
+		nr = min_t(unsigned, nr_pages - page_idx, PAGEVEC_SIZE);
+		for (i = 0; i < nr; i++) {
+			batch[i] = list_to_page(pages);
+			list_del(&batch[i]->lru);
+		}
+
+		added = add_to_page_cache_lru_batch(batch, nr, mapping,
+						    GFP_KERNEL);
+		for (i = 0; i < nr; i++) {
+			struct page *page = batch[i];
+
+			if (i < added || !add_to_page_cache_lru(page, mapping,
+						page->index, GFP_KERNEL)) {
+				mapping->a_ops->readpage(filp, page);
+			}
+			page_cache_release(page);
 		}
-		page_cache_release(page);
 	}
 	ret = 0;
 
@@ -195,8 +207,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		__add_bdi_stat(mapping->backing_dev_info, BDI_RA_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -336,6 +350,194 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+/*
+ * Several streams per file.
+ *
+ * Interleaved sequential reads through one file, whether from one task
+ * walking several regions or from several tasks sharing the fd, would
+ * keep replacing each other's readahead window.  So when a new window is
+ * started, the current one is parked in ra->parked[] instead of being
+ * forgotten, and a read that continues a parked window swaps it back in.
+ * The least recently used parked stream falls off the end.
+ */
+static bool ra_continues(pgoff_t start, unsigned int size,
+			 unsigned int async_size, pgoff_t offset)
+{
+	return offset == start + size - async_size || offset == start + size;
+}
+
+/*
+ * Readahead feedback.
+ *
+ * Whenever a stream moves its window forward, the window it leaves behind
+ * has been read: those pages count as hits.  Whenever a stream is dropped,
+ * its last window is checked for pages nobody referenced: those were wasted.
+ * After RA_ADAPT_PERIOD maximum windows' worth of pages, the file's window
+ * limit is halved if more than a quarter of them were wasted, and doubled
+ * back towards ra_pages if less than 1/16 were.
+ */
+#define RA_ADAPT_PERIOD		4
+#define RA_MAX_SHRINK		3
+
+static unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	return max_sane_readahead(max(ra->ra_pages >> ra->shrink, 1U));
+}
+
+static void ra_account(struct address_space *mapping,
+		       struct file_ra_state *ra,
+		       unsigned long hits, unsigned long waste)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long total;
+
+	__add_bdi_stat(bdi, BDI_RA_HITS, hits);
+	__add_bdi_stat(bdi, BDI_RA_WASTE, waste);
+
+	ra->hits += hits;
+	ra->waste += waste;
+	total = ra->hits + ra->waste;
+	if (total < RA_ADAPT_PERIOD * ra->ra_pages)
+		return;
+
+	if (ra->waste * 4 > total) {
+		if (ra->shrink < RA_MAX_SHRINK)
+			ra->shrink++;
+	} else if (ra->waste * 16 < total) {
+		if (ra->shrink)
+			ra->shrink--;
+	}
+	ra->hits = ra->waste = 0;
+}
+
+static void ra_drop_window(struct address_space *mapping,
+			   struct file_ra_state *ra,
+			   pgoff_t start, unsigned long size)
+{
+	pgoff_t index = start, end = start + size;
+	unsigned long used = 0, unused = 0;
+	struct pagevec pvec;
+	int i;
+
+	pagevec_init(&pvec, 0);
+	while (index < end && pagevec_lookup(&pvec, mapping, index,
+			min(end - index, (pgoff_t)PAGEVEC_SIZE))) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			index = page->index + 1;
+			if (page->index >= end)
+				break;
+			if (PageReferenced(page) || PageActive(page) ||
+			    page_mapped(page))
+				used++;
+			else
+				unused++;
+		}
+		pagevec_release(&pvec);
+	}
+	ra_account(mapping, ra, used, unused);
+}
+
+/*
+ * Park the current stream before starting a new one at @offset, unless
+ * @offset is just the current stream having lost its window.
+ */
+static void ra_park_stream(struct address_space *mapping,
+			   struct file_ra_state *ra, pgoff_t offset)
+{
+	struct ra_stream *last = &ra->parked[RA_PARKED_STREAMS - 1];
+
+	if (!ra->size ||
+	    (offset >= ra->start && offset <= ra->start + ra->size))
+		return;
+	if (last->size)
+		ra_drop_window(mapping, ra, last->start, last->size);
+
+	memmove(&ra->parked[1], &ra->parked[0],
+		(RA_PARKED_STREAMS - 1) * sizeof(ra->parked[0]));
+	ra->parked[0].start = ra->start;
+	ra->parked[0].size = ra->size;
+	ra->parked[0].async_size = ra->async_size;
+}
+
+static bool ra_unpark_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct ra_stream found;
+	int i;
+
+	for (i = 0; i < RA_PARKED_STREAMS; i++) {
+		struct ra_stream *s = &ra->parked[i];
+
+		if (s->size && ra_continues(s->start, s->size,
+					    s->async_size, offset))
+			break;
+	}
+	if (i == RA_PARKED_STREAMS)
+		return false;
+
+	found = ra->parked[i];
+	if (ra->size) {
+		memmove(&ra->parked[1], &ra->parked[0],
+			i * sizeof(ra->parked[0]));
+		ra->parked[0].start = ra->start;
+		ra->parked[0].size = ra->size;
+		ra->parked[0].async_size = ra->async_size;
+	} else {
+		memmove(&ra->parked[i], &ra->parked[i + 1],
+			(RA_PARKED_STREAMS - 1 - i) * sizeof(ra->parked[0]));
+		ra->parked[RA_PARKED_STREAMS - 1].size = 0;
+	}
+	ra->start = found.start;
+	ra->size = found.size;
+	ra->async_size = found.async_size;
+	return true;
+}
+
+/*
+ * Strided reads.
+ *
+ * Small reads a fixed distance apart, as when scanning one column of a
+ * table, look random to the sequential logic.  After RA_STRIDE_MIN reads at
+ * the same distance, also read the next strides that fit into the window,
+ * and mark the last one so the reader kicks off the next batch from
+ * page_cache_async_readahead() when it gets there.
+ */
+#define RA_STRIDE_MIN		2
+
+static unsigned long stride_readahead(struct address_space *mapping,
+				      struct file_ra_state *ra,
+				      struct file *filp, pgoff_t offset,
+				      unsigned long req_size,
+				      unsigned long max)
+{
+	unsigned long nr = 0, i, n;
+
+	n = max(max / req_size, 1UL);
+	for (i = 1; i <= n; i++)
+		nr += __do_page_cache_readahead(mapping, filp,
+				offset + i * ra->stride, req_size,
+				i == n ? req_size : 0);
+	ra->stride_prev = offset + n * ra->stride;
+	return nr;
+}
+
+static bool ra_stride_detected(struct file_ra_state *ra, pgoff_t offset,
+			       unsigned long req_size)
+{
+	if (offset > ra->stride_prev &&
+	    offset - ra->stride_prev == ra->stride) {
+		ra->stride_count++;
+	} else {
+		ra->stride = offset > ra->stride_prev ?
+			offset - ra->stride_prev : 0;
+		ra->stride_count = 0;
+	}
+	ra->stride_prev = offset;
+
+	return ra->stride > req_size && ra->stride_count >= RA_STRIDE_MIN;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -382,6 +584,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_park_stream(mapping, ra, offset);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
 	ra->async_size = ra->size;
@@ -398,7 +601,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(ra);
 
 	/*
 	 * start of file
@@ -408,16 +611,26 @@ ondemand_readahead(struct address_space *mapping,
 
 	/*
 	 * It's the expected callback offset, assume sequential access.
-	 * Ramp up sizes, and push forward the readahead window.
+	 * Ramp up sizes, and push forward the readahead window.  The same
+	 * goes for the expected offset of a parked stream.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	if (ra_continues(ra->start, ra->size, ra->async_size, offset) ||
+	    ra_unpark_stream(ra, offset)) {
+		ra_account(mapping, ra, ra->size, 0);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
 		goto readit;
 	}
 
+	/*
+	 * The marker left at the end of a batch of strided reads.
+	 */
+	if (hit_readahead_marker && ra->stride_count >= RA_STRIDE_MIN &&
+	    offset == ra->stride_prev && ra->stride > req_size)
+		return stride_readahead(mapping, ra, filp, offset,
+					req_size, max);
+
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
@@ -434,6 +647,7 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_park_stream(mapping, ra, offset);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -461,6 +675,15 @@ ondemand_readahead(struct address_space *mapping,
 	if (try_context_readahead(mapping, ra, offset, req_size, max))
 		goto readit;
 
+	/*
+	 * the same distance from the previous small read, several times
+	 */
+	if (ra_stride_detected(ra, offset, req_size))
+		return __do_page_cache_readahead(mapping, filp, offset,
+						 req_size, 0) +
+		       stride_readahead(mapping, ra, filp, offset,
+					req_size, max);
+
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
@@ -468,6 +691,7 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra_park_stream(mapping, ra, offset);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -692,16 +692,80 @@ int page_mapped_in_vma(struct page *page, struct vm_area_struct *vma)
  * Subfunctions of page_referenced: page_referenced_one called
  * repeatedly from either page_referenced_anon or page_referenced_file.
  */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Page cache pages mapped by a huge pmd (see filemap_pmd_fault()) are
+ * ordinary pages, invisible to page_check_address().  Returns the pmd
+ * mapping @page at @address, with page_table_lock held, or NULL.
+ */
+static pmd_t *page_check_file_pmd(struct page *page,
+				  struct vm_area_struct *vma,
+				  unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	unsigned long pfn = page_to_pfn(page);
+	unsigned long idx = (address - haddr) >> PAGE_SHIFT;
+	struct page *head;
+	pmd_t *pmd;
+
+	if (PageAnon(page) || !vma->vm_ops || !vma->vm_ops->pmd_fault)
+		return NULL;
+	if (pfn < idx)
+		return NULL;
+	head = pfn_to_page(pfn - idx);
+
+	/* Make a quick check before getting the lock */
+	if (!page_check_address_pmd(head, mm, haddr,
+				    PAGE_CHECK_ADDRESS_PMD_FLAG))
+		return NULL;
+	spin_lock(&mm->page_table_lock);
+	pmd = page_check_address_pmd(head, mm, haddr,
+				     PAGE_CHECK_ADDRESS_PMD_FLAG);
+	if (!pmd)
+		spin_unlock(&mm->page_table_lock);
+	return pmd;
+}
+
+/*
+ * All pages under a file pmd share its accessed bit.  Only the first of
+ * them clears it, so that each of them sees the references made since
+ * the block was last aged, instead of the first one checked taking them.
+ */
+static int page_file_pmd_young(struct page *page, struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	if (address == haddr)
+		return pmdp_clear_flush_young_notify(vma, haddr, pmd);
+	return pmd_young(*pmd);
+}
+#else
+static inline pmd_t *page_check_file_pmd(struct page *page,
+					 struct vm_area_struct *vma,
+					 unsigned long address)
+{
+	return NULL;
+}
+
+static inline int page_file_pmd_young(struct page *page,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd)
+{
+	return 0;
+}
+#endif
+
 int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 			unsigned long address, unsigned int *mapcount,
 			unsigned long *vm_flags)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	int referenced = 0;
+	pmd_t *pmd;
 
 	if (unlikely(PageTransHuge(page))) {
-		pmd_t *pmd;
-
 		spin_lock(&mm->page_table_lock);
 		/*
 		 * rmap might return false positives; we must filter
@@ -725,6 +789,19 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		if (pmdp_clear_flush_young_notify(vma, address, pmd))
 			referenced++;
 		spin_unlock(&mm->page_table_lock);
+	} else if ((pmd = page_check_file_pmd(page, vma, address))) {
+		if (vma->vm_flags & VM_LOCKED) {
+			spin_unlock(&mm->page_table_lock);
+			*mapcount = 0;	/* break early from loop */
+			*vm_flags |= VM_LOCKED;
+			goto out;
+		}
+
+		/* see the pte case below */
+		if (page_file_pmd_young(page, vma, address, pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			referenced++;
+		spin_unlock(&mm->page_table_lock);
 	} else {
 		pte_t *pte;
 		spinlock_t *ptl;
@@ -1220,6 +1297,10 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	/* A huge pmd mapping page cache is split back to ptes first */
+	if (!PageAnon(page) && vma->vm_ops && vma->vm_ops->pmd_fault)
+		split_file_huge_page_address(vma, address);
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
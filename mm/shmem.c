@@ -828,6 +828,23 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0,
+			       numa_node_id());
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -846,6 +863,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -855,6 +880,140 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * tmpfs mounts ask for huge pages with huge=always; the internal mount
+ * backing SysV shm and shared anonymous memory follows the sysfs knob
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled.
+ */
+static bool shmem_huge_enabled(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (SHMEM_SB(sb)->huge)
+		return true;
+	return shm_mnt && sb == shm_mnt->mnt_sb && transparent_hugepage_shmem();
+}
+
+/*
+ * shmem_alloc_huge - populate the huge page sized block around @index
+ *
+ * A huge page for tmpfs is not a compound page: the block is allocated
+ * in one go so that it is physically contiguous and suitably aligned,
+ * then split into order-0 pages which enter the page cache one by one.
+ * Everything else (swap, truncation, partial writes) keeps working on
+ * small pages, while the fault path can map the whole block with a pmd.
+ *
+ * Returns 0 if the page at @index was added to the page cache.
+ */
+static int shmem_alloc_huge(struct inode *inode, pgoff_t index, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = index & ~((pgoff_t)HPAGE_PMD_NR - 1);
+	unsigned long found;
+	struct page *page;
+	void **slot;
+	int i, nr, error = 0;
+
+	if (((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+	    i_size_read(inode))
+		return -EINVAL;
+
+	/* Only fill holes entirely: a swap entry counts as a page */
+	rcu_read_lock();
+	if (radix_tree_gang_lookup_slot(&mapping->page_tree, &slot, &found,
+					hindex, 1) &&
+	    found < hindex + HPAGE_PMD_NR)
+		error = -EEXIST;
+	rcu_read_unlock();
+	if (error)
+		return error;
+
+	if ((info->flags & VM_NORESERVE) &&
+	    security_vm_enough_memory_kern(VM_ACCT(HPAGE_PMD_SIZE)))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0) {
+			error = -ENOSPC;
+			goto unacct;
+		}
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	page = shmem_alloc_hugepage(gfp | __GFP_NORETRY | __GFP_NOWARN |
+				    __GFP_NO_KSWAPD, info, hindex);
+	if (!page) {
+		error = -ENOMEM;
+		goto decused;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(page, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *subpage = page + i;
+
+		SetPageSwapBacked(subpage);
+		__set_page_locked(subpage);
+		clear_highpage(subpage);
+		flush_dcache_page(subpage);
+		SetPageUptodate(subpage);
+		error = mem_cgroup_cache_charge(subpage, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(subpage, mapping,
+						hindex + i, gfp, NULL);
+		if (error)
+			break;
+		lru_cache_add_anon(subpage);
+		unlock_page(subpage);
+		page_cache_release(subpage);
+	}
+
+	spin_lock(&info->lock);
+	info->alloced += i;
+	inode->i_blocks += i * BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	if (i == HPAGE_PMD_NR)
+		return 0;
+
+	/* Racing with another allocation: hand back what was left */
+	error = (index < hindex + i) ? 0 : -EEXIST;
+	nr = HPAGE_PMD_NR - i;
+	for (; i < HPAGE_PMD_NR; i++) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -nr);
+	shmem_unacct_blocks(info->flags, nr);
+	return error;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return error;
+}
+#else
+static inline bool shmem_huge_enabled(struct inode *inode)
+{
+	return false;
+}
+
+static inline int shmem_alloc_huge(struct inode *inode, pgoff_t index,
+				   gfp_t gfp)
+{
+	return -EINVAL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -956,6 +1115,10 @@ repeat:
 		swap_free(swap);
 
 	} else {
+		if (sgp != SGP_READ && shmem_huge_enabled(inode) &&
+		    !shmem_alloc_huge(inode, index, gfp))
+			goto repeat;
+
 		if (shmem_acct_block(info->flags)) {
 			error = -ENOSPC;
 			goto failed;
@@ -1065,6 +1228,32 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	struct page *page;
+	pgoff_t pgoff;
+	int error;
+
+	/* Private mappings would have to break COW on the whole block */
+	if ((vma->vm_flags & (VM_SHARED | VM_NOHUGEPAGE)) != VM_SHARED ||
+	    !shmem_huge_enabled(inode))
+		return VM_FAULT_FALLBACK;
+
+	/* Allocates the surrounding huge block if the range is a hole */
+	pgoff = ((address - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	error = shmem_getpage(inode, pgoff, &page, SGP_CACHE, NULL);
+	if (error)
+		return VM_FAULT_FALLBACK;
+	unlock_page(page);
+	page_cache_release(page);
+
+	return do_huge_pmd_file_page(vma, address, pmd);
+}
+#endif
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -2090,6 +2279,15 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			if (!strcmp(value, "always"))
+				sbinfo->huge = true;
+			else if (!strcmp(value, "never"))
+				sbinfo->huge = false;
+			else
+				goto bad_val;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2135,6 +2333,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2158,6 +2357,8 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=always");
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2374,6 +2575,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -254,6 +254,8 @@ struct vmap_area {
 	unsigned long va_end;
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
+	unsigned long subtree_max_gap;	/* largest free gap in front of an
+					   area of this subtree */
 	struct list_head list;		/* address sorted list */
 	struct list_head purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
@@ -264,12 +266,6 @@ static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
@@ -291,6 +287,52 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+/*
+ * The free gap in front of @va: the distance from the end of the previous
+ * area in address order (or from 0, for the lowest area) to @va's start.
+ * Relies on vmap_area_list being up to date with the tree.
+ */
+static unsigned long vmap_area_gap(struct vmap_area *va)
+{
+	struct vmap_area *prev;
+
+	if (va->list.prev == &vmap_area_list)
+		return va->va_start;
+	prev = list_entry(va->list.prev, struct vmap_area, list);
+	return va->va_start - prev->va_end;
+}
+
+/*
+ * Every node caches the largest free gap in front of any area in its
+ * subtree, so alloc_vmap_area can skip whole subtrees that cannot fit
+ * the request and find the lowest suitable hole in O(log n).
+ */
+static void vmap_area_augment_cb(struct rb_node *node, void *unused)
+{
+	struct vmap_area *va = rb_entry(node, struct vmap_area, rb_node);
+	unsigned long max_gap = vmap_area_gap(va);
+	struct vmap_area *child;
+
+	if (node->rb_left) {
+		child = rb_entry(node->rb_left, struct vmap_area, rb_node);
+		max_gap = max(max_gap, child->subtree_max_gap);
+	}
+	if (node->rb_right) {
+		child = rb_entry(node->rb_right, struct vmap_area, rb_node);
+		max_gap = max(max_gap, child->subtree_max_gap);
+	}
+	va->subtree_max_gap = max_gap;
+}
+
+/* Propagate a change of @node's own gap up to the root */
+static void vmap_area_augment_path(struct rb_node *node)
+{
+	while (node) {
+		vmap_area_augment_cb(node, NULL);
+		node = rb_parent(node);
+	}
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
@@ -321,10 +363,111 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/*
+	 * The new area splits the gap in front of its successor, so
+	 * the successor's path to the root needs updating as well.
+	 */
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+	tmp = rb_next(&va->rb_node);
+	if (tmp)
+		vmap_area_augment_path(tmp);
 }
 
 static void purge_vmap_area_lazy(void);
 
+/*
+ * Try to fit @size bytes aligned to @align into the free range
+ * [@start, @end), clipped to [@vstart, @vend).
+ */
+static bool vmap_gap_fits(unsigned long start, unsigned long end,
+			unsigned long size, unsigned long align,
+			unsigned long vstart, unsigned long vend,
+			unsigned long *addr)
+{
+	unsigned long a;
+
+	start = max(start, vstart);
+	end = min(end, vend);
+	a = ALIGN(start, align);
+	if (a < start || a >= end || end - a < size)
+		return false;
+	*addr = a;
+	return true;
+}
+
+/*
+ * Find the lowest address in [vstart, vend) with room for @size bytes
+ * aligned to @align.  The tree is walked in address order, but subtrees
+ * whose largest gap is smaller than @size, or which lie entirely outside
+ * [vstart, vend), are never entered.  Returns vend if nothing fits.
+ */
+static unsigned long __find_vmap_lowest_gap(unsigned long size,
+				unsigned long align,
+				unsigned long vstart, unsigned long vend)
+{
+	struct rb_node *n = vmap_area_root.rb_node;
+	struct vmap_area *va, *child;
+	unsigned long gap_start, addr;
+
+	if (!n)
+		goto check_highest;
+	va = rb_entry(n, struct vmap_area, rb_node);
+	if (va->subtree_max_gap < size)
+		goto check_highest;
+
+	while (true) {
+		/* Lower gaps live in the left subtree */
+		n = va->rb_node.rb_left;
+		if (n && va->va_start > vstart) {
+			child = rb_entry(n, struct vmap_area, rb_node);
+			if (child->subtree_max_gap >= size) {
+				va = child;
+				continue;
+			}
+		}
+check_current:
+		gap_start = va->va_start - vmap_area_gap(va);
+		if (gap_start >= vend)
+			return vend;
+		if (vmap_gap_fits(gap_start, va->va_start, size, align,
+				  vstart, vend, &addr))
+			return addr;
+
+		n = va->rb_node.rb_right;
+		if (n && va->va_end < vend) {
+			child = rb_entry(n, struct vmap_area, rb_node);
+			if (child->subtree_max_gap >= size) {
+				va = child;
+				continue;
+			}
+		}
+
+		/* Climb to the first ancestor we are in the left subtree of */
+		while (true) {
+			struct rb_node *prev = &va->rb_node;
+
+			n = rb_parent(prev);
+			if (!n)
+				goto check_highest;
+			va = rb_entry(n, struct vmap_area, rb_node);
+			if (prev == n->rb_left)
+				goto check_current;
+		}
+	}
+
+check_highest:
+	/* The hole above the highest area */
+	if (list_empty(&vmap_area_list))
+		addr = 0;
+	else
+		addr = list_entry(vmap_area_list.prev,
+				  struct vmap_area, list)->va_end;
+	if (vmap_gap_fits(addr, vend, size, align, vstart, vend, &addr))
+		return addr;
+	return vend;
+}
+
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
  * vstart and vend.
@@ -335,10 +478,8 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
@@ -351,84 +492,14 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
-	}
-
-found:
-	if (addr + size > vend)
+	addr = __find_vmap_lowest_gap(size, align, vstart, vend);
+	if (addr == vend)
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -454,27 +525,21 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct rb_node *deepest, *next;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
+	deepest = rb_augment_erase_begin(&va->rb_node);
+	next = rb_next(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
 
+	/* The successor inherits the gap in front of the freed area */
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
+	if (next)
+		vmap_area_augment_path(next);
+
 	/*
 	 * Track the highest possible candidate for pcpu area
 	 * allocation.  Areas outside of vmalloc area can be returned
@@ -565,6 +630,43 @@ void set_iounmap_nonlazy(void)
 	atomic_set(&vmap_lazy_nr, lazy_max_pages()+1);
 }
 
+/*
+ * Lazily freed areas are scattered all over the vmalloc space, so rather
+ * than flushing one range from the lowest to the highest of them (which
+ * architectures that flush kernel ranges page by page pay for in full),
+ * the purge flushes up to VMAP_PURGE_RANGES separate ranges.  Areas less
+ * than VMAP_PURGE_MERGE_GAP apart are coalesced into the same range, and
+ * once all ranges are in use the last one just keeps growing.
+ *
+ * Where flush_tlb_kernel_range() flushes everything anyway (x86), every
+ * extra range would be another global flush: there, one range covers
+ * all areas and the caller's range too.
+ */
+#ifdef ARCH_HAS_RANGED_KERNEL_TLB_FLUSH
+#define VMAP_PURGE_RANGES	4
+#else
+#define VMAP_PURGE_RANGES	1
+#endif
+#define VMAP_PURGE_MERGE_GAP	(256UL * PAGE_SIZE)
+
+struct vmap_purge_range {
+	unsigned long start, end;
+};
+
+static int vmap_purge_add_range(struct vmap_purge_range *ranges, int nr,
+				unsigned long start, unsigned long end)
+{
+	/* Areas come in address order, so only the last range can grow */
+	if (nr && (nr >= VMAP_PURGE_RANGES ||
+		   start - ranges[nr - 1].end <= VMAP_PURGE_MERGE_GAP)) {
+		ranges[nr - 1].end = end;
+		return nr;
+	}
+	ranges[nr].start = start;
+	ranges[nr].end = end;
+	return nr + 1;
+}
+
 /*
  * Purges all lazily-freed vmap areas.
  *
@@ -579,10 +681,14 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
+	struct vmap_purge_range ranges[VMAP_PURGE_RANGES];
+	unsigned long flush_start = *start, flush_end = *end;
 	LIST_HEAD(valist);
 	struct vmap_area *va;
 	struct vmap_area *n_va;
+	int nr_ranges = 0;
 	int nr = 0;
+	int i;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -606,6 +712,8 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 			if (va->va_end > *end)
 				*end = va->va_end;
 			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+			nr_ranges = vmap_purge_add_range(ranges, nr_ranges,
+						va->va_start, va->va_end);
 			list_add_tail(&va->purge_list, &valist);
 			va->flags |= VM_LAZY_FREEING;
 			va->flags &= ~VM_LAZY_FREE;
@@ -616,8 +724,16 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
-	if (nr || force_flush)
-		flush_tlb_kernel_range(*start, *end);
+	/* The caller's own range is flushed separately from ours */
+	if (force_flush && flush_start < flush_end) {
+		if (VMAP_PURGE_RANGES == 1 && nr_ranges) {
+			ranges[0].start = min(ranges[0].start, flush_start);
+			ranges[0].end = max(ranges[0].end, flush_end);
+		} else
+			flush_tlb_kernel_range(flush_start, flush_end);
+	}
+	for (i = 0; i < nr_ranges; i++)
+		flush_tlb_kernel_range(ranges[i].start, ranges[i].end);
 
 	if (nr) {
 		spin_lock(&vmap_area_lock);
@@ -720,8 +836,8 @@ static void free_unmap_vmap_area_addr(unsigned long addr)
 #endif
 
 #define VMALLOC_PAGES		(VMALLOC_SPACE / PAGE_SIZE)
-#define VMAP_MAX_ALLOC		BITS_PER_LONG	/* 256K with 4K pages */
-#define VMAP_BBMAP_BITS_MAX	1024	/* 4MB with 4K pages */
+#define VMAP_MAX_ALLOC		(BITS_PER_LONG*2) /* 512K with 4K pages */
+#define VMAP_BBMAP_BITS_MAX	2048	/* 8MB with 4K pages */
 #define VMAP_BBMAP_BITS_MIN	(VMAP_MAX_ALLOC*2)
 #define VMAP_MIN(x, y)		((x) < (y) ? (x) : (y)) /* can't use min() */
 #define VMAP_MAX(x, y)		((x) > (y) ? (x) : (y)) /* can't use max() */
@@ -374,12 +374,7 @@ static void skb_drop_list(struct sk_buff **listp)
 	struct sk_buff *list = *listp;
 
 	*listp = NULL;
-
-	do {
-		struct sk_buff *this = list;
-		list = list->next;
-		kfree_skb(this);
-	} while (list);
+	kfree_skb_list(list);
 }
 
 static inline void skb_drop_fraglist(struct sk_buff *skb)
@@ -551,6 +546,84 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+#define KFREE_SKB_BULK_SIZE	16
+
+struct skb_free_array {
+	unsigned int	skb_count;
+	void		*skb_array[KFREE_SKB_BULK_SIZE];
+};
+
+static void kfree_skb_add_bulk(struct sk_buff *skb, struct skb_free_array *sa)
+{
+	/* fast clones share their memory, leave them to kfree_skbmem() */
+	if (unlikely(skb->fclone != SKB_FCLONE_UNAVAILABLE)) {
+		__kfree_skb(skb);
+		return;
+	}
+
+	skb_release_all(skb);
+	sa->skb_array[sa->skb_count++] = skb;
+	if (unlikely(sa->skb_count == KFREE_SKB_BULK_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, KFREE_SKB_BULK_SIZE,
+				     sa->skb_array);
+		sa->skb_count = 0;
+	}
+}
+
+/**
+ *	__kfree_skb_list - free a list of unreferenced skbs
+ *	@segs: list of buffers linked through skb->next
+ *
+ *	Like calling __kfree_skb() on each buffer, but the sk_buff heads
+ *	are handed back to the slab allocator in batches.
+ */
+void __kfree_skb_list(struct sk_buff *segs)
+{
+	struct skb_free_array sa;
+
+	sa.skb_count = 0;
+	while (segs) {
+		struct sk_buff *next = segs->next;
+
+		kfree_skb_add_bulk(segs, &sa);
+		segs = next;
+	}
+	if (sa.skb_count)
+		kmem_cache_free_bulk(skbuff_head_cache, sa.skb_count,
+				     sa.skb_array);
+}
+EXPORT_SYMBOL(__kfree_skb_list);
+
+/**
+ *	kfree_skb_list - free a list of skbs
+ *	@segs: list of buffers linked through skb->next
+ *
+ *	Drop a reference to each buffer, and free those whose usage count
+ *	hit zero in batches.
+ */
+void kfree_skb_list(struct sk_buff *segs)
+{
+	struct skb_free_array sa;
+
+	sa.skb_count = 0;
+	while (segs) {
+		struct sk_buff *next = segs->next;
+
+		if (likely(atomic_read(&segs->users) == 1))
+			smp_rmb();
+		else if (likely(!atomic_dec_and_test(&segs->users)))
+			goto next;
+		trace_kfree_skb(segs, __builtin_return_address(0));
+		kfree_skb_add_bulk(segs, &sa);
+next:
+		segs = next;
+	}
+	if (sa.skb_count)
+		kmem_cache_free_bulk(skbuff_head_cache, sa.skb_count,
+				     sa.skb_array);
+}
+EXPORT_SYMBOL(kfree_skb_list);
+
 /**
  * 	skb_recycle - clean up an skb for reuse
  * 	@skb: buffer
@@ -33,6 +33,10 @@
 # CONFIG_PRINTK_TIME configuration option enabled, and with
 # "initcall_debug" passed on the kernel command line.
 #
+# Initcalls run by different threads, as async calls or parallel
+# initcalls with "initcall_parallel", are drawn on separate rows, and
+# the parallelism achieved is printed on top of the graph and on stderr.
+#
 # usage:
 # 	dmesg | perl scripts/bootgraph.pl > output.svg
 #
@@ -197,4 +201,24 @@ while ($time < $maxtime) {
 	$time = $time + $step;
 }
 
+# report how much the initcalls overlapped: time spent in initcalls
+# over the time they took together
+my $busy = 0;
+my %threads;
+foreach my $key (@initcalls) {
+	if ($type{$key} != 0 || !defined($end{$key})) {
+		next;
+	}
+	$busy = $busy + $end{$key} - $start{$key};
+	$threads{defined($pids{$key}) ? $pids{$key} : 0} = 1;
+}
+if ($maxtime > $firsttime) {
+	my $summary = sprintf("%d threads, %.3f s of initcalls in %.3f s: " .
+			      "parallelism %.2f", scalar(keys(%threads)),
+			      $busy, $maxtime - $firsttime,
+			      $busy / ($maxtime - $firsttime));
+	print "<text transform=\"translate(0,40)\">$summary</text>\n";
+	print STDERR "$summary\n";
+}
+
 print "</svg>\n";
@@ -215,6 +215,7 @@ static int symbol_valid(struct sym_entry *s)
 		"kallsyms_markers",
 		"kallsyms_token_table",
 		"kallsyms_token_index",
+		"kallsyms_seqs_of_names",
 
 	/* Exclude linker generated symbols which vary between passes */
 		"_SDA_BASE_",		/* ppc */
@@ -314,11 +315,60 @@ static int expand_symbol(unsigned char *data, int len, char *result)
 	return total;
 }
 
+static char **sym_names;
+
+/* order by name, without the type char, then by position */
+static int compare_names(const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned int *)a;
+	unsigned int ib = *(const unsigned int *)b;
+	int ret;
+
+	ret = strcmp(sym_names[ia] + 1, sym_names[ib] + 1);
+	if (ret)
+		return ret;
+	return ia < ib ? -1 : ia > ib;
+}
+
+/* return the symbol positions sorted by name, for binary searches */
+static unsigned int *sort_symbols_by_name(void)
+{
+	unsigned int i, *seqs;
+	char buf[500];
+
+	seqs = malloc(sizeof(*seqs) * table_cnt);
+	sym_names = malloc(sizeof(*sym_names) * table_cnt);
+	if (!seqs || !sym_names) {
+		fprintf(stderr, "kallsyms failure: "
+			"unable to allocate required memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < table_cnt; i++) {
+		expand_symbol(table[i].sym, table[i].len, buf);
+		sym_names[i] = strdup(buf);
+		if (!sym_names[i]) {
+			fprintf(stderr, "kallsyms failure: "
+				"unable to allocate required memory\n");
+			exit(EXIT_FAILURE);
+		}
+		seqs[i] = i;
+	}
+
+	qsort(seqs, table_cnt, sizeof(*seqs), compare_names);
+
+	for (i = 0; i < table_cnt; i++)
+		free(sym_names[i]);
+	free(sym_names);
+
+	return seqs;
+}
+
 static void write_src(void)
 {
 	unsigned int i, k, off;
 	unsigned int best_idx[256];
-	unsigned int *markers;
+	unsigned int *markers, *seqs;
 	char buf[KSYM_NAME_LEN];
 
 	printf("#include <asm/types.h>\n");
@@ -403,6 +453,16 @@ static void write_src(void)
 	for (i = 0; i < 256; i++)
 		printf("\t.short\t%d\n", best_idx[i]);
 	printf("\n");
+
+	/* symbol positions sorted by name, for lookups by name */
+	seqs = sort_symbols_by_name();
+
+	output_label("kallsyms_seqs_of_names");
+	for (i = 0; i < table_cnt; i++)
+		printf("\t.long\t%u\n", seqs[i]);
+	printf("\n");
+
+	free(seqs);
 }
 
 
@@ -0,0 +1,180 @@
+/*
+ * audit-syscall.c
+ *
+ * syscall: cost of syscall auditing with a large rule set.  Times a
+ * cheap syscall, getppid(), first as it is, then with a number of exit
+ * list rules loaded, each of them on some other syscall and none of
+ * them ever matching.  Needs CAP_AUDIT_CONTROL, and auditing enabled
+ * before perf is started, so that perf gets an audit context.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/audit.h>
+
+/* syscall numbers the rules are spread over */
+#define NR_RULE_SYSCALLS	256
+
+static int nr_rules = 1000;
+static int nr_loops = 1000000;
+
+static const struct option options[] = {
+	OPT_INTEGER('r', "rules", &nr_rules,
+		    "Number of audit rules loaded"),
+	OPT_INTEGER('l', "loops", &nr_loops,
+		    "Number of syscalls timed"),
+	OPT_END()
+};
+
+static const char * const bench_audit_syscall_usage[] = {
+	"perf bench audit syscall <options>",
+	NULL
+};
+
+static int audit_fd;
+static int audit_seq;
+
+static int audit_request(int type, struct audit_rule_data *rule)
+{
+	char buf[NLMSG_SPACE(sizeof(*rule))];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct sockaddr_nl addr;
+	struct nlmsgerr *err;
+	ssize_t len;
+
+	memset(buf, 0, sizeof(buf));
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*rule));
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh->nlmsg_seq = ++audit_seq;
+	memcpy(NLMSG_DATA(nlh), rule, sizeof(*rule));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	if (sendto(audit_fd, buf, nlh->nlmsg_len, 0,
+		   (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		return -errno;
+
+	do {
+		len = recv(audit_fd, buf, sizeof(buf), 0);
+		if (len < 0)
+			return -errno;
+	} while (!NLMSG_OK(nlh, len) || nlh->nlmsg_seq != audit_seq);
+
+	if (nlh->nlmsg_type != NLMSG_ERROR)
+		return 0;
+	err = NLMSG_DATA(nlh);
+	return err->error;
+}
+
+/* Rule i audits syscall i % NR_RULE_SYSCALLS when a0 is i, which it never is */
+static void make_rule(struct audit_rule_data *rule, int i)
+{
+	int nr = i % NR_RULE_SYSCALLS;
+
+	if (nr == __NR_getppid)
+		nr = NR_RULE_SYSCALLS;
+
+	memset(rule, 0, sizeof(*rule));
+	rule->flags = AUDIT_FILTER_EXIT;
+	rule->action = AUDIT_ALWAYS;
+	rule->mask[AUDIT_WORD(nr)] |= AUDIT_BIT(nr);
+	rule->field_count = 1;
+	rule->fields[0] = AUDIT_ARG0;
+	rule->fieldflags[0] = AUDIT_EQUAL;
+	rule->values[0] = 0x80000000 + i;
+}
+
+static double time_syscall(void)
+{
+	struct timeval start, stop, diff;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_loops; i++)
+		syscall(__NR_getppid);
+	gettimeofday(&stop, NULL);
+
+	timersub(&stop, &start, &diff);
+	return (diff.tv_sec * 1000000000.0 + diff.tv_usec * 1000.0) / nr_loops;
+}
+
+int bench_audit_syscall(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct audit_rule_data rule;
+	double bare, audited;
+	int i, err, loaded = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_audit_syscall_usage, 0);
+
+	if (nr_rules < 0 || nr_loops <= 0) {
+		fprintf(stderr, "Invalid number of rules or loops\n");
+		return 1;
+	}
+
+	audit_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_AUDIT);
+	if (audit_fd < 0) {
+		perror("socket (is CONFIG_AUDIT set?)");
+		return 1;
+	}
+
+	bare = time_syscall();
+
+	for (i = 0; i < nr_rules; i++) {
+		make_rule(&rule, i);
+		err = audit_request(AUDIT_ADD_RULE, &rule);
+		if (err) {
+			fprintf(stderr, "adding rule %d: %s\n", i,
+				strerror(-err));
+			break;
+		}
+		loaded++;
+	}
+
+	audited = time_syscall();
+
+	for (i = 0; i < loaded; i++) {
+		make_rule(&rule, i);
+		err = audit_request(AUDIT_DEL_RULE, &rule);
+		if (err)
+			fprintf(stderr, "deleting rule %d: %s\n", i,
+				strerror(-err));
+	}
+	close(audit_fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d getppid() calls, %d audit rules on %d other "
+		       "syscalls\n\n", nr_loops, loaded, NR_RULE_SYSCALLS);
+		printf(" %14s: %.1f nsecs/call\n", "No rules", bare);
+		printf(" %14s: %.1f nsecs/call\n", "With rules", audited);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.1f\n", audited);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return loaded == nr_rules ? 0 : 1;
+}
@@ -3,7 +3,14 @@
 
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_sched_jitter(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_page_fault(int argc, const char **argv, const char *prefix);
+extern int bench_mem_file_write(int argc, const char **argv, const char *prefix);
+extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
+extern int bench_module_load(int argc, const char **argv, const char *prefix);
+extern int bench_ipc_sem(int argc, const char **argv, const char *prefix);
+extern int bench_audit_syscall(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,170 @@
+/*
+ * futex-hash.c
+ *
+ * futex-hash: throughput of futex operations on the kernel's futex hash
+ * table.  Each thread issues FUTEX_WAIT on a set of private futexes of
+ * its own with an expected value that never matches, so every call takes
+ * the hash bucket lock and returns -EWOULDBLOCK straight away.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+
+#ifndef FUTEX_PRIVATE_FLAG
+#define FUTEX_PRIVATE_FLAG	128
+#endif
+
+static int nr_threads;
+static int nr_secs = 10;
+static int nr_futexes = 1024;
+static bool silent;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Number of threads (default: online CPUs)"),
+	OPT_INTEGER('r', "runtime", &nr_secs,
+		    "Runtime in seconds"),
+	OPT_INTEGER('f', "futexes", &nr_futexes,
+		    "Number of futexes per thread"),
+	OPT_BOOLEAN('s', "silent", &silent,
+		    "Do not print per-thread results"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	u32 *futex;
+	unsigned long ops;
+};
+
+static volatile int done;
+static pthread_barrier_t barrier;
+
+static void *hash_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	int i;
+
+	pthread_barrier_wait(&barrier);
+	while (!done) {
+		for (i = 0; i < nr_futexes; i++) {
+			/* futex word is 0, expecting 1: returns at once */
+			if (syscall(__NR_futex, &w->futex[i],
+				    FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 1,
+				    NULL, NULL, 0) == 0 || errno != EAGAIN) {
+				perror("futex");
+				exit(1);
+			}
+		}
+		ops += nr_futexes;
+	}
+	w->ops = ops;
+	return NULL;
+}
+
+static void stop_handler(int sig __used)
+{
+	done = 1;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long total = 0;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_secs <= 0 || nr_futexes <= 0) {
+		fprintf(stderr, "Invalid runtime or number of futexes\n");
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+	pthread_barrier_init(&barrier, NULL, nr_threads + 1);
+	signal(SIGALRM, stop_handler);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].futex = calloc(nr_futexes, sizeof(u32));
+		if (!workers[i].futex)
+			die("calloc");
+		if (pthread_create(&workers[i].thread, NULL, hash_thread,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	pthread_barrier_wait(&barrier);
+	gettimeofday(&start, NULL);
+	alarm(nr_secs);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	gettimeofday(&stop, NULL);
+
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	for (i = 0; i < nr_threads; i++)
+		total += workers[i].ops;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads operating on %d private futexes each "
+		       "for %d secs\n\n", nr_threads, nr_futexes, nr_secs);
+		if (!silent) {
+			for (i = 0; i < nr_threads; i++)
+				printf(" [thread %3d] %14.0lf ops/sec\n", i,
+				       workers[i].ops / secs);
+			printf("\n");
+		}
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0lf ops/sec\n", total / secs);
+		printf(" %14.0lf ops/sec/thread\n", total / secs / nr_threads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_barrier_destroy(&barrier);
+	for (i = 0; i < nr_threads; i++)
+		free(workers[i].futex);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * ipc-sem.c
+ *
+ * sem: throughput of System V semaphore operations.  All threads share
+ * one semaphore array, and each of them increments and decrements a
+ * semaphore of its own with semop(), the way databases use one array
+ * for all their processes.  With --shared they all use the same
+ * semaphore instead, and with --complex every semop() also waits for a
+ * second semaphore, which is always 0, to be 0.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+static int nr_threads;
+static int nr_secs = 10;
+static bool shared;
+static bool complex_ops;
+static bool undo;
+static bool silent;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Number of threads (default: online CPUs)"),
+	OPT_INTEGER('r', "runtime", &nr_secs,
+		    "Runtime in seconds"),
+	OPT_BOOLEAN('S', "shared", &shared,
+		    "All threads operate on the same semaphore"),
+	OPT_BOOLEAN('c', "complex", &complex_ops,
+		    "Operate on two semaphores in each semop()"),
+	OPT_BOOLEAN('u', "undo", &undo,
+		    "Use SEM_UNDO"),
+	OPT_BOOLEAN('s', "silent", &silent,
+		    "Do not print per-thread results"),
+	OPT_END()
+};
+
+static const char * const bench_ipc_sem_usage[] = {
+	"perf bench ipc sem <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned short semnum;
+	unsigned long ops;
+};
+
+static int semid;
+static volatile int done;
+static pthread_barrier_t barrier;
+
+static void *sem_thread(void *arg)
+{
+	struct worker *w = arg;
+	struct sembuf up[2], down[2];
+	unsigned long ops = 0;
+	int nsops = complex_ops ? 2 : 1;
+	short flg = undo ? SEM_UNDO : 0;
+
+	up[0].sem_num = down[0].sem_num = w->semnum;
+	up[0].sem_op = 1;
+	down[0].sem_op = -1;
+	up[0].sem_flg = down[0].sem_flg = flg;
+	/* the last semaphore of the array is never touched: stays 0 */
+	up[1].sem_num = down[1].sem_num = nr_threads;
+	up[1].sem_op = down[1].sem_op = 0;
+	up[1].sem_flg = down[1].sem_flg = 0;
+
+	pthread_barrier_wait(&barrier);
+	while (!done) {
+		if (semop(semid, up, nsops) || semop(semid, down, nsops)) {
+			perror("semop");
+			exit(1);
+		}
+		ops += 2;
+	}
+	w->ops = ops;
+	return NULL;
+}
+
+static void stop_handler(int sig __used)
+{
+	done = 1;
+}
+
+int bench_ipc_sem(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long total = 0;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_ipc_sem_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_secs <= 0) {
+		fprintf(stderr, "Invalid runtime\n");
+		return 1;
+	}
+
+	/* one semaphore per thread, plus the one that stays 0 */
+	semid = semget(IPC_PRIVATE, nr_threads + 1, IPC_CREAT | 0600);
+	if (semid < 0) {
+		perror("semget (check kernel.sem's SEMMSL)");
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+	pthread_barrier_init(&barrier, NULL, nr_threads + 1);
+	signal(SIGALRM, stop_handler);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].semnum = shared ? 0 : i;
+		if (pthread_create(&workers[i].thread, NULL, sem_thread,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	pthread_barrier_wait(&barrier);
+	gettimeofday(&start, NULL);
+	alarm(nr_secs);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	gettimeofday(&stop, NULL);
+	semctl(semid, 0, IPC_RMID);
+
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	for (i = 0; i < nr_threads; i++)
+		total += workers[i].ops;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads operating on %s of one array%s%s "
+		       "for %d secs\n\n", nr_threads,
+		       shared ? "the same semaphore" : "a semaphore each",
+		       complex_ops ? ", two at a time" : "",
+		       undo ? ", with SEM_UNDO" : "", nr_secs);
+		if (!silent) {
+			for (i = 0; i < nr_threads; i++)
+				printf(" [thread %3d] %14.0lf ops/sec\n", i,
+				       workers[i].ops / secs);
+			printf("\n");
+		}
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0lf ops/sec\n", total / secs);
+		printf(" %14.0lf ops/sec/thread\n", total / secs / nr_threads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_barrier_destroy(&barrier);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * mem-file-write.c
+ *
+ * file-write: buffered write throughput of several threads writing
+ * disjoint ranges of one shared file, which all dirty pages of the
+ * same page cache mapping
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static int nr_threads;
+static const char *size_str = "64MB";
+static const char *bs_str = "4KB";
+static const char *dir = ".";
+static int loops = 4;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Number of writing threads (default: online CPUs)"),
+	OPT_STRING('s', "size", &size_str, "64MB",
+		   "Size of each thread's range of the file"),
+	OPT_STRING('b', "block", &bs_str, "4KB",
+		   "Size of each write()"),
+	OPT_STRING('d', "directory", &dir, ".",
+		   "Directory to create the test file in"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Number of times each thread rewrites its range"),
+	OPT_END()
+};
+
+static const char * const bench_mem_file_write_usage[] = {
+	"perf bench mem file-write <options>",
+	NULL
+};
+
+static int fd;
+static size_t range_size, block_size;
+static pthread_barrier_t barrier;
+
+static void *write_thread(void *arg)
+{
+	off_t base = (long)arg * range_size;
+	size_t off;
+	char *buf;
+	int i;
+
+	buf = malloc(block_size);
+	if (!buf)
+		die("malloc");
+	memset(buf, 0x5a, block_size);
+
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < loops; i++) {
+		for (off = 0; off < range_size; off += block_size) {
+			if (pwrite(fd, buf, block_size, base + off) < 0) {
+				perror("pwrite");
+				exit(1);
+			}
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+int bench_mem_file_write(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	pthread_t *threads;
+	struct timeval start, stop, diff;
+	char path[PATH_MAX];
+	double secs, bytes;
+	s64 size, bs;
+	long i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_file_write_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	size = perf_atoll(size_str);
+	bs = perf_atoll(bs_str);
+	if (size <= 0 || bs <= 0 || loops <= 0) {
+		fprintf(stderr, "Invalid size, block size or loop count\n");
+		return 1;
+	}
+	block_size = bs;
+	range_size = (size + block_size - 1) / block_size * block_size;
+
+	snprintf(path, sizeof(path), "%s/perf-bench-file-write.XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(path);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	pthread_barrier_init(&barrier, NULL, nr_threads + 1);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, write_thread, (void *)i))
+			die("pthread_create");
+
+	pthread_barrier_wait(&barrier);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	bytes = (double)nr_threads * loops * range_size;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads writing %s each in %s blocks, %d times\n\n",
+		       nr_threads, size_str, bs_str, loops);
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.3lf MB/sec\n", bytes / secs / (1 << 20));
+		printf(" %14.0lf writes/sec\n", bytes / block_size / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3lf\n", bytes / secs / (1 << 20));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+	close(fd);
+	return 0;
+}
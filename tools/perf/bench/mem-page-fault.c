@@ -0,0 +1,196 @@
+/*
+ * mem-page-fault.c
+ *
+ * page-fault: multithreaded anonymous page fault throughput, optionally
+ * while another thread keeps calling mmap()/munmap() on the same mm
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE 15
+#endif
+
+static int nr_threads;
+static const char *size_str = "64MB";
+static int loops = 10;
+static bool churn;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Number of faulting threads (default: online CPUs)"),
+	OPT_STRING('s', "size", &size_str, "64MB",
+		   "Memory faulted per thread and loop"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Number of times each thread faults its area in"),
+	OPT_BOOLEAN('m', "mmap-churn", &churn,
+		    "Run a thread doing mmap()/munmap() meanwhile"),
+	OPT_END()
+};
+
+static const char * const bench_mem_page_fault_usage[] = {
+	"perf bench mem page-fault <options>",
+	NULL
+};
+
+static size_t area_size;
+static long page_size;
+static volatile int done;
+static pthread_barrier_t barrier;
+
+static void *fault_thread(void *arg __used)
+{
+	char *area;
+	size_t off;
+	int i;
+
+	area = mmap(NULL, area_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	/* Keep THP out of the way: we want one fault per page */
+	madvise(area, area_size, MADV_NOHUGEPAGE);
+
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < loops; i++) {
+		for (off = 0; off < area_size; off += page_size)
+			area[off] = 1;
+		madvise(area, area_size, MADV_DONTNEED);
+	}
+	munmap(area, area_size);
+	return NULL;
+}
+
+static void *churn_thread(void *arg)
+{
+	unsigned long *nr_churn = arg;
+	void *p;
+
+	pthread_barrier_wait(&barrier);
+	while (!done) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+			munmap(p, page_size);
+		(*nr_churn)++;
+	}
+	return NULL;
+}
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0, v;
+	char key[64];
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %llu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+int bench_mem_page_fault(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	pthread_t *threads, churner;
+	unsigned long nr_churn = 0;
+	unsigned long long nr_faults, spf_start, spf;
+	struct timeval start, stop, diff;
+	double secs;
+	s64 size;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_page_fault_usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	size = perf_atoll(size_str);
+	if (size <= 0 || loops <= 0) {
+		fprintf(stderr, "Invalid size or loop count\n");
+		return 1;
+	}
+	area_size = (size + page_size - 1) & ~(page_size - 1);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	pthread_barrier_init(&barrier, NULL, nr_threads + churn + 1);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, fault_thread, NULL))
+			die("pthread_create");
+	if (churn && pthread_create(&churner, NULL, churn_thread, &nr_churn))
+		die("pthread_create");
+
+	spf_start = read_vmstat("speculative_pgfault");
+	pthread_barrier_wait(&barrier);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	done = 1;
+	if (churn)
+		pthread_join(churner, NULL);
+	spf = read_vmstat("speculative_pgfault") - spf_start;
+
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+	nr_faults = (unsigned long long)nr_threads * loops *
+		(area_size / page_size);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads faulting %s %d times each%s\n\n",
+		       nr_threads, size_str, loops,
+		       churn ? ", with mmap/munmap churn" : "");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14.0lf faults/sec\n", nr_faults / secs);
+		printf(" %14.0lf faults/sec/thread\n",
+		       nr_faults / secs / nr_threads);
+		if (churn)
+			printf(" %14.0lf mmap+munmap/sec\n", nr_churn / secs);
+		printf(" %14llu speculative faults\n", spf);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", nr_faults / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_barrier_destroy(&barrier);
+	free(threads);
+	return 0;
+}
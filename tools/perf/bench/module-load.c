@@ -0,0 +1,198 @@
+/*
+ * module-load.c
+ *
+ * load: loads the modules given on the command line from several
+ * threads at once, the way udev does at coldplug, and reports how long
+ * it took.  The module files are read in before the clock starts, so
+ * only init_module() is measured, module init functions included.
+ * Needs CAP_SYS_MODULE, and modules which are not loaded already.
+ * Without any module files it does nothing.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static int nr_threads;
+static bool unload;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Number of loading threads (default: online CPUs)"),
+	OPT_BOOLEAN('u', "unload", &unload,
+		    "Unload the modules again afterwards"),
+	OPT_END()
+};
+
+static const char * const bench_module_load_usage[] = {
+	"perf bench module load <options> <module.ko>...",
+	NULL
+};
+
+struct module_file {
+	const char *path;
+	char name[64];
+	void *image;
+	size_t len;
+	u64 usecs;
+	int err;
+};
+
+static struct module_file *files;
+static int nr_files;
+static int next_file;
+
+static u64 now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void read_module(struct module_file *f)
+{
+	const char *base = strrchr(f->path, '/');
+	struct stat st;
+	char *p;
+	int fd;
+
+	fd = open(f->path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		die("%s: %s", f->path, strerror(errno));
+	f->len = st.st_size;
+	f->image = malloc(f->len);
+	if (!f->image)
+		die("malloc");
+	if (read(fd, f->image, f->len) != (ssize_t)f->len)
+		die("%s: short read", f->path);
+	close(fd);
+
+	/* foo-bar.ko is module foo_bar */
+	strncpy(f->name, base ? base + 1 : f->path, sizeof(f->name) - 1);
+	p = strstr(f->name, ".ko");
+	if (p)
+		*p = '\0';
+	for (p = f->name; *p; p++)
+		if (*p == '-')
+			*p = '_';
+}
+
+static void *load_thread(void *arg __used)
+{
+	struct module_file *f;
+	u64 start;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&next_file, 1)) < nr_files) {
+		f = &files[i];
+		start = now_usec();
+		if (syscall(__NR_init_module, f->image, f->len, ""))
+			f->err = errno;
+		f->usecs = now_usec() - start;
+	}
+	return NULL;
+}
+
+int bench_module_load(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	pthread_t *threads;
+	u64 start, total, sum = 0, max = 0;
+	int i, nr_loaded = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_module_load_usage, 0);
+	/* nothing to load, e.g. when run by 'perf bench all' */
+	if (argc < 1) {
+		printf("# No module files given, skipping\n");
+		return 0;
+	}
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	nr_files = argc;
+	files = calloc(nr_files, sizeof(*files));
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!files || !threads)
+		die("calloc");
+	for (i = 0; i < nr_files; i++) {
+		files[i].path = argv[i];
+		read_module(&files[i]);
+	}
+
+	start = now_usec();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, load_thread, NULL))
+			die("pthread_create");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	total = now_usec() - start;
+
+	for (i = 0; i < nr_files; i++) {
+		if (files[i].err) {
+			fprintf(stderr, "%s: %s\n", files[i].path,
+				strerror(files[i].err));
+			continue;
+		}
+		nr_loaded++;
+		sum += files[i].usecs;
+		if (files[i].usecs > max)
+			max = files[i].usecs;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Loading %d modules from %d threads\n\n",
+		       nr_files, nr_threads);
+		printf(" %14s: %d\n", "Loaded", nr_loaded);
+		printf(" %14s: %d\n", "Failed", nr_files - nr_loaded);
+		printf(" %14s: %.3f msecs\n", "Total time", total / 1000.0);
+		if (nr_loaded) {
+			printf(" %14s: %.3f msecs\n", "Average load",
+			       sum / 1000.0 / nr_loaded);
+			printf(" %14s: %.3f msecs\n", "Slowest load",
+			       max / 1000.0);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", total / 1000.0);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	/* in reverse, so that users go before the modules they depend on */
+	for (i = nr_files - 1; unload && i >= 0; i--) {
+		if (files[i].err)
+			continue;
+		if (syscall(__NR_delete_module, files[i].name, O_NONBLOCK))
+			fprintf(stderr, "%s: cannot unload: %s\n",
+				files[i].name, strerror(errno));
+	}
+
+	for (i = 0; i < nr_files; i++)
+		free(files[i].image);
+	free(files);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * sched-jitter.c
+ *
+ * jitter: a busy loop reading the clock, pinned to one CPU, which
+ * reports each time it was kept from running by more than a threshold:
+ * ticks, interrupts, softirqs and other tasks. Run it on a nohz_full=
+ * CPU to see what is left of the tick.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+static int cpu = -1;
+static int runtime = 10;
+static int threshold = 5;
+
+static const struct option options[] = {
+	OPT_INTEGER('c', "cpu", &cpu,
+		    "CPU to pin the loop to (default: the current one)"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Seconds to run for"),
+	OPT_INTEGER('t', "threshold", &threshold,
+		    "Smallest gap reported as an interruption, in usecs"),
+	OPT_END()
+};
+
+static const char * const bench_sched_jitter_usage[] = {
+	"perf bench sched jitter <options>",
+	NULL
+};
+
+/* gaps in usecs: [threshold, 2*threshold), ... , [2^(NR_BUCKETS-1)*threshold, inf) */
+#define NR_BUCKETS	12
+
+static unsigned long buckets[NR_BUCKETS];
+
+static u64 now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int bench_sched_jitter(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	u64 start, end, prev, now, gap, min_gap, max_gap = 0;
+	u64 total = 0, nr_gaps = 0, loops = 0;
+	cpu_set_t mask;
+	int i, b;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_jitter_usage, 0);
+
+	if (runtime <= 0 || threshold <= 0) {
+		fprintf(stderr, "Invalid runtime or threshold\n");
+		return 1;
+	}
+
+	if (cpu < 0)
+		cpu = sched_getcpu();
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	min_gap = threshold * 1000ULL;
+	start = prev = now_nsec();
+	end = start + runtime * 1000000000ULL;
+
+	do {
+		now = now_nsec();
+		gap = now - prev;
+		prev = now;
+		loops++;
+
+		if (gap < min_gap)
+			continue;
+
+		nr_gaps++;
+		total += gap;
+		if (gap > max_gap)
+			max_gap = gap;
+		for (b = 0; b < NR_BUCKETS - 1; b++)
+			if (gap < (min_gap << (b + 1)))
+				break;
+		buckets[b]++;
+	} while (now < end);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Busy loop on CPU %d for %d sec, "
+		       "reporting gaps of %d usecs or more\n\n",
+		       cpu, runtime, threshold);
+		printf(" %14s: %" PRIu64 "\n", "Loops", loops);
+		printf(" %14s: %" PRIu64 "\n", "Interruptions", nr_gaps);
+		printf(" %14s: %.3f usecs\n", "Max gap", max_gap / 1000.0);
+		printf(" %14s: %.6f %%\n\n", "Time lost",
+		       100.0 * total / (now - start));
+		for (i = 0; i < NR_BUCKETS; i++) {
+			if (!buckets[i])
+				continue;
+			if (i == NR_BUCKETS - 1)
+				printf(" %8d usecs and more: %lu\n",
+				       threshold << i, buckets[i]);
+			else
+				printf(" %8d - %8d usecs: %lu\n",
+				       threshold << i, threshold << (i + 1),
+				       buckets[i]);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%" PRIu64 " %.3f\n", nr_gaps, max_gap / 1000.0);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
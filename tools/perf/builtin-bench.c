@@ -13,6 +13,10 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex performance
+ *  module ... module loading performance
+ *  ipc   ... System V IPC performance
+ *  audit ... syscall auditing performance
  *
  */
 
@@ -42,6 +46,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "jitter",
+	  "Interruptions of a busy loop pinned to one CPU",
+	  bench_sched_jitter    },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -52,6 +59,52 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "page-fault",
+	  "Multithreaded anonymous page faults, with optional mmap churn",
+	  bench_mem_page_fault },
+	{ "file-write",
+	  "Multithreaded buffered writes to one shared file",
+	  bench_mem_file_write },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Multithreaded operations on private futexes of the futex hash",
+	  bench_futex_hash },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite module_suites[] = {
+	{ "load",
+	  "Load modules from several threads at once, like coldplug",
+	  bench_module_load },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite ipc_suites[] = {
+	{ "sem",
+	  "Multithreaded semop() on the semaphores of one array",
+	  bench_ipc_sem },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite audit_suites[] = {
+	{ "syscall",
+	  "Cost of a syscall with a large set of audit rules loaded",
+	  bench_audit_syscall },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +124,18 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex performance",
+	  futex_suites },
+	{ "module",
+	  "module loading performance",
+	  module_suites },
+	{ "ipc",
+	  "System V IPC performance",
+	  ipc_suites },
+	{ "audit",
+	  "syscall auditing performance",
+	  audit_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },